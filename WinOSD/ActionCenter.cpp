@@ -1,29 +1,105 @@
 #include "ActionCenter.h"
+#include "Animation.h"
 #include "LayeredRender.h"
 
+#include "hash.h"
 #include "logging.h"
 #include "strings.h"
+#include "timer.h"
 
-Image DownloadImage(const std::wstring &url);
+#include <limits>
 
-ActionCenter::ActionCenter()
+ActionCenter::ActionCenter() :
+    pRender(nullptr)
 {}
 
+CachedImage ActionCenter::OpenImage(std::string_view encoded, const std::function<std::vector<uint8_t>()> &fetch,
+                                    Image::ResizeMode mode)
+{
+    if (encoded.empty()) {
+        return CachedImage();
+    }
+
+    TIMEIT_START(OpenImage);
+
+    // the pyramid only keeps the display width, so the same payload resized in
+    // another mode or for another width is a different image
+    int maxWidth = pRender ? (int)pRender->GetDrawableWidth() : 0;
+    uint64_t key = hash::xxh64(encoded.data(), encoded.size(), (uint64_t)maxWidth << 8 | mode);
+    TIMEIT(OpenImage, "Hash");
+
+    if (auto cached = imageCache.Find(key)) {
+        DBG << "Image cache hit: " << std::hex << key;
+        return cached;
+    }
+
+    auto buffer = std::make_shared<std::vector<uint8_t>>(fetch());
+    if (buffer->empty()) {
+        return CachedImage();
+    }
+    TIMEIT(OpenImage, "Fetch");
+
+    CachedImage result;
+
+    // the full canvas, toasts get their size from the pyramid
+    if (auto animation = Animation::open(buffer, std::numeric_limits<int>::max())) {
+        int delay;
+        const Image &frame = animation->NextFrame(delay);
+
+        // keep the encoded file, every toast streams its own frames from it
+        Image first = Image::create(frame.width, frame.height, frame.ch, frame.order);
+        if (first) {
+            memcpy(first.data, frame.data, frame.size());
+            result.image = std::make_shared<ImagePyramid>(std::move(first), maxWidth, mode);
+            result.animation = std::move(buffer);
+            result.animated = true;
+            result.frameWidth = animation->width();
+            result.frameHeight = animation->height();
+        }
+        TIMEIT(OpenImage, "Open animation");
+    }
+
+    if (!result.image) {
+        Image im = Image::open(buffer->data(), buffer->size());
+        if (!im) {
+            return CachedImage();
+        }
+        TIMEIT(OpenImage, "Decode");
+
+        result.image = std::make_shared<ImagePyramid>(std::move(im), maxWidth, mode);
+    }
+
+    imageCache.Insert(key, result);
+
+    TIMEIT_END(OpenImage);
+    return result;
+}
+
 int ActionCenter::AddToast(Toast &&toast)
 {
     if (!pRender) {
         return -1;
     }
 
-    float maxWidth = pRender->GetDrawableWidth();
-    if (toast.image.width > maxWidth) {
-        int w = (int)maxWidth;
-        int h = (int)(toast.image.height * maxWidth / toast.image.width);
+    // nearest pyramid level plus a final resample
+    std::shared_ptr<const Image> fitted;
+    if (toast.image) {
+        TIMEIT_START(FitImage);
+        fitted = toast.image.image->Scaled((int)pRender->GetDrawableWidth());
+        TIMEIT_END(FitImage);
+    }
+
+    static const Image noImage;
+    const Image &im = fitted ? *fitted : noImage;
 
-        toast.image = toast.image.resize(w, h);
+    // every toast plays from its own decoder, the cache knows it is animated
+    std::shared_ptr<Animation> animation;
+    if (toast.image.animated && im) {
+        animation = Animation::open(toast.image.animation, toast.image.frameWidth, toast.image.frameHeight,
+                                    im.width, toast.resizeMode);
     }
 
-    auto toastId = pRender->AddToast(toast.title, toast.text, toast.image, toast.link);
+    auto toastId = pRender->AddToast(toast.title, toast.text, im, toast.link, animation);
     if (toastId > 0) {
         pRender->SetTopMost(3.f);
     }
@@ -33,3 +109,18 @@ int ActionCenter::AddToast(Toast &&toast)
 
 ActionCenter::~ActionCenter()
 {}
+
+TextLayoutCache::Stats ActionCenter::GetLayoutCacheStats() const
+{
+    return pRender->GetLayoutCacheStats();
+}
+
+SnapshotListStats ActionCenter::GetToastListStats() const
+{
+    return pRender->GetToastListStats();
+}
+
+RenderCommandStats ActionCenter::GetCommandStats() const
+{
+    return pRender->GetCommandStats();
+}
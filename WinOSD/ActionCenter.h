@@ -1,20 +1,35 @@
 #pragma once
 
+#include <functional>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "Image.h"
+#include "ImageCache.h"
+#include "SnapshotList.h"
+#include "StringTable.h"
+#include "TextLayoutCache.h"
 
 struct Toast
 {
     int priority;
-    std::wstring title;
-    std::wstring text;
-    Image image;
-    std::wstring link;
+
+    // UTF-8, converted for DirectWrite when the toast is laid out. Interned
+    // since titles, links and often texts repeat across toasts.
+    InternedString title;
+    InternedString text;
+
+    // the first frame of an animated image is in its pyramid
+    CachedImage image;
+    InternedString link;
+
+    Image::ResizeMode resizeMode = Image::Naive;
 };
 
 class LayeredRender;
+struct RenderCommandStats;
 
 class ActionCenter
 {
@@ -24,6 +39,21 @@ public:
 
     int AddToast(Toast &&toast);
 
+    // Get the decoded image. `encoded` is the payload as received (raw or base64),
+    // `fetch` returns the image file and is only called when the payload has not
+    // been seen before. The toast scales it from the pyramid when it is shown.
+    CachedImage OpenImage(std::string_view encoded, const std::function<std::vector<uint8_t>()> &fetch,
+                          Image::ResizeMode mode = Image::Naive);
+
+    ImageCache::Stats GetImageCacheStats() const
+    {
+        return imageCache.GetStats();
+    }
+
+    TextLayoutCache::Stats GetLayoutCacheStats() const;
+    SnapshotListStats GetToastListStats() const;
+    RenderCommandStats GetCommandStats() const;
+
     void SetRender(LayeredRender *render)
     {
         pRender = render;
@@ -31,4 +61,5 @@ public:
 
 private:
     LayeredRender *pRender;
+    ImageCache imageCache;
 };
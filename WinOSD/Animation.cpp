@@ -0,0 +1,216 @@
+#include "Animation.h"
+#include "ImageDecoder.h"
+
+#include "logging.h"
+
+#ifdef USE_OPENCV
+#undef USE_LIBWEBP
+#endif
+
+#ifdef USE_LIBWEBP
+#include <webp/demux.h>
+#pragma comment(lib, "libwebpdemux.lib")
+#endif
+
+// GIF commonly uses 0 for "as fast as possible", browsers clamp it as well
+constexpr int defaultFrameDelay = 100;
+constexpr int minFrameDelay = 20;
+
+#ifdef USE_LIBWEBP
+namespace {
+class WebPFrames : public FrameSource
+{
+public:
+    WebPFrames(const uint8_t *data, size_t len)
+    {
+        WebPAnimDecoderOptions options;
+        if (!WebPAnimDecoderOptionsInit(&options)) {
+            return;
+        }
+
+        options.color_mode = MODE_BGRA;
+        options.use_threads = 0;
+
+        WebPData webp = { data, len };
+        decoder = WebPAnimDecoderNew(&webp, &options);
+        if (decoder == nullptr) {
+            return;
+        }
+
+        WebPAnimInfo info;
+        if (!WebPAnimDecoderGetInfo(decoder, &info)) {
+            return;
+        }
+
+        width = (int)info.canvas_width;
+        height = (int)info.canvas_height;
+        frameCount = (int)info.frame_count;
+        order = Image::BGR;
+    }
+
+    ~WebPFrames()
+    {
+        if (decoder) {
+            WebPAnimDecoderDelete(decoder);
+        }
+    }
+
+    bool animated() override
+    {
+        return frameCount > 1;
+    }
+
+    const uint8_t *next(int &delay) override
+    {
+        if (!decoder || !WebPAnimDecoderHasMoreFrames(decoder)) {
+            return nullptr;
+        }
+
+        uint8_t *canvas;
+        int timestamp;
+        if (!WebPAnimDecoderGetNext(decoder, &canvas, &timestamp)) {
+            return nullptr;
+        }
+
+        // timestamp is the end time of the frame
+        delay = timestamp - lastTimestamp;
+        lastTimestamp = timestamp;
+        return canvas;
+    }
+
+    bool rewind() override
+    {
+        if (!decoder) {
+            return false;
+        }
+
+        WebPAnimDecoderReset(decoder);
+        lastTimestamp = 0;
+        return true;
+    }
+
+private:
+    WebPAnimDecoder *decoder = nullptr;
+    int frameCount = 0;
+    int lastTimestamp = 0;
+};
+}
+#endif
+
+std::unique_ptr<FrameSource> Animation::OpenSource(const uint8_t *data, size_t len, int width, int height)
+{
+    switch (SniffImageFormat(data, len)) {
+#ifndef USE_OPENCV
+    case ImageFormat::GIF:
+        return OpenGifFrames(data, len, width, height);
+#endif
+#ifdef USE_LIBWEBP
+    case ImageFormat::WebP:
+        return std::make_unique<WebPFrames>(data, len);
+#endif
+    default:
+        // APNG is neither supported by stb_image nor libspng, only the first frame is shown
+        return nullptr;
+    }
+}
+
+std::shared_ptr<Animation> Animation::open(Buffer data, int maxWidth, Image::ResizeMode mode)
+{
+    if (!data || data->empty()) {
+        return nullptr;
+    }
+
+    auto source = OpenSource(data->data(), data->size());
+    if (!source || !source->animated() || !source->rewind()) {
+        return nullptr;
+    }
+
+    return Fit(std::move(data), std::move(source), maxWidth, mode);
+}
+
+std::shared_ptr<Animation> Animation::open(Buffer data, int width, int height, int maxWidth, Image::ResizeMode mode)
+{
+    if (!data || data->empty() || width <= 0 || height <= 0) {
+        return nullptr;
+    }
+
+    auto source = OpenSource(data->data(), data->size(), width, height);
+    if (!source) {
+        return nullptr;
+    }
+
+    return Fit(std::move(data), std::move(source), maxWidth, mode);
+}
+
+std::shared_ptr<Animation> Animation::Fit(Buffer data, std::unique_ptr<FrameSource> source, int maxWidth,
+                                          Image::ResizeMode mode)
+{
+    int w = source->width;
+    int h = source->height;
+    if (w <= 0 || h <= 0) {
+        return nullptr;
+    }
+
+    if (w > maxWidth) {
+        h = (int)((float)h * maxWidth / w);
+        w = maxWidth;
+    }
+
+    DBG << "Animation " << source->width << "x" << source->height << " fitted to " << w << "x" << h;
+
+    return std::shared_ptr<Animation>(new Animation(std::move(data), std::move(source), w, h, mode));
+}
+
+Animation::Animation(Buffer data, std::unique_ptr<FrameSource> source, int w, int h, Image::ResizeMode mode) :
+    data(std::move(data)), source(std::move(source)), frameWidth(w), frameHeight(h), mode(mode)
+{
+    for (auto &frame : ring) {
+        frame = Image::create(w, h, 4, this->source->order);
+    }
+}
+
+const Image &Animation::NextFrame(int &delay)
+{
+    std::lock_guard _(lock);
+
+    cursor = (cursor + 1) % ringSize;
+    Image &frame = ring[cursor];
+
+    const uint8_t *canvas = source->next(delay);
+    if (canvas == nullptr) {
+        // loop forever
+        if (source->rewind()) {
+            canvas = source->next(delay);
+        }
+
+        if (canvas == nullptr) {
+            DBG << "Unable to decode animation frame";
+            delay = defaultFrameDelay;
+            return ring[(cursor + ringSize - 1) % ringSize];
+        }
+    }
+
+    if (delay <= 0) {
+        delay = defaultFrameDelay;
+    } else if (delay < minFrameDelay) {
+        delay = minFrameDelay;
+    }
+
+#ifndef USE_OPENCV
+    if (!frame) {
+        return frame;
+    }
+
+    if (source->width == frameWidth && source->height == frameHeight) {
+        memcpy(frame.data, canvas, frame.size());
+    } else if (mode == Image::LinearLight) {
+        ResizeLinearLight(canvas, source->width, source->height, (size_t)source->width * 4,
+                          frame.data, frame.width, frame.height, (size_t)frame.width * 4, 4);
+    } else {
+        stbir_resize_uint8(canvas, source->width, source->height, source->width * 4,
+                           frame.data, frame.width, frame.height, frame.width * 4, 4);
+    }
+#endif
+
+    return frame;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Image.h"
+
+// Sequential access to the frames of an animated image. Every frame is
+// composed onto a full size 4 channel canvas, owned by the source.
+class FrameSource
+{
+public:
+    virtual ~FrameSource() = default;
+
+    // has more than one frame
+    virtual bool animated() = 0;
+
+    // canvas of the next frame, or nullptr at the end of the stream
+    virtual const uint8_t *next(int &delay) = 0;
+    virtual bool rewind() = 0;
+
+    int width = 0;
+    int height = 0;
+    Image::PixelOrder order = Image::RGB;
+};
+
+// stb_image internals are only visible to Image.cpp. With a known canvas size
+// nothing is decoded up front, otherwise the first frame is to find it.
+std::unique_ptr<FrameSource> OpenGifFrames(const uint8_t *data, size_t len, int width = 0, int height = 0);
+
+// Animated GIF/WebP which decodes its frames lazily. Only a small ring of
+// frames already fitted to the toast is kept in memory, no matter how many
+// frames the animation has.
+class Animation
+{
+public:
+    using Buffer = std::shared_ptr<const std::vector<uint8_t>>;
+
+    // nullptr if the data is not an animation with more than one frame
+    static std::shared_ptr<Animation> open(Buffer data, int maxWidth, Image::ResizeMode mode = Image::Naive);
+
+    // for data already known to be an animation with a width x height canvas,
+    // e.g. from the image cache, skips probing the frames
+    static std::shared_ptr<Animation> open(Buffer data, int width, int height, int maxWidth,
+                                           Image::ResizeMode mode = Image::Naive);
+
+    int width() const
+    {
+        return frameWidth;
+    }
+
+    int height() const
+    {
+        return frameHeight;
+    }
+
+    // Decode the next frame into the ring, looping at the end of the animation.
+    // The frame stays valid until the ring wraps around.
+    const Image &NextFrame(int &delay);
+
+private:
+    Animation(Buffer data, std::unique_ptr<FrameSource> source, int w, int h, Image::ResizeMode mode);
+
+    static std::unique_ptr<FrameSource> OpenSource(const uint8_t *data, size_t len, int width = 0, int height = 0);
+
+    static std::shared_ptr<Animation> Fit(Buffer data, std::unique_ptr<FrameSource> source, int maxWidth,
+                                          Image::ResizeMode mode);
+
+    static constexpr int ringSize = 2;
+
+    // the source decodes straight from the encoded buffer
+    Buffer data;
+    std::unique_ptr<FrameSource> source;
+
+    int frameWidth, frameHeight;
+    Image::ResizeMode mode;
+
+    std::mutex lock;
+    Image ring[ringSize];
+    int cursor = 0;
+};
@@ -0,0 +1,186 @@
+#include "DistanceField.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+constexpr float infinity = 1e20f;
+
+// Squared euclidean distance transform of a sampled function in one dimension,
+// the lower envelope of parabolas by Felzenszwalb and Huttenlocher
+void Transform1D(const float *f, size_t n, float *d, int *v, float *z)
+{
+    // samples without a feature pixel never become part of the envelope
+    int k = -1;
+    for (int q = 0; q < (int)n; q++) {
+        if (f[q] >= infinity) {
+            continue;
+        }
+
+        if (k < 0) {
+            k = 0;
+            v[0] = q;
+            z[0] = -infinity;
+            z[1] = infinity;
+            continue;
+        }
+
+        float s;
+        for (;;) {
+            int p = v[k];
+            s = ((f[q] + (float)q * q) - (f[p] + (float)p * p)) / (2.f * (q - p));
+            if (s > z[k]) {
+                break;
+            }
+            k--;
+        }
+
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = infinity;
+    }
+
+    if (k < 0) {
+        std::fill(d, d + n, infinity);
+        return;
+    }
+
+    k = 0;
+    for (int q = 0; q < (int)n; q++) {
+        while (z[k + 1] < q) {
+            k++;
+        }
+        int p = v[k];
+        d[q] = (float)(q - p) * (q - p) + f[p];
+    }
+}
+
+// Squared distance from every pixel to the nearest pixel where `grid` is 0. Both
+// passes run along rows, the columns are transposed into rows in between.
+void Transform2D(std::vector<float> &grid, int width, int height)
+{
+    size_t n = (size_t)std::max(width, height);
+    std::vector<float> d(n), z(n + 1);
+    std::vector<int> v(n);
+
+    std::vector<float> transposed(grid.size());
+    for (int y = 0; y < height; y++) {
+        Transform1D(&grid[(size_t)y * width], width, d.data(), v.data(), z.data());
+        for (int x = 0; x < width; x++) {
+            transposed[(size_t)x * height + y] = d[x];
+        }
+    }
+
+    for (int x = 0; x < width; x++) {
+        Transform1D(&transposed[(size_t)x * height], height, d.data(), v.data(), z.data());
+        for (int y = 0; y < height; y++) {
+            grid[(size_t)y * width + x] = d[y];
+        }
+    }
+}
+
+uint8_t ToByte(float alpha)
+{
+    return (uint8_t)(std::clamp(alpha, 0.f, 1.f) * 255.f + 0.5f);
+}
+}
+
+void GenerateDistanceField(const uint8_t *mask, size_t stride, int width, int height, int scale, float *field)
+{
+    const int w = width * scale;
+    const int h = height * scale;
+    const size_t count = (size_t)w * h;
+
+    // distances to the nearest pixel inside, and to the nearest one outside
+    std::vector<float> toInside(count), toOutside(count);
+    for (int y = 0; y < h; y++) {
+        const uint8_t *row = mask + y * stride;
+        for (int x = 0; x < w; x++) {
+            bool inside = row[x] != 0;
+            toInside[(size_t)y * w + x] = inside ? 0.f : infinity;
+            toOutside[(size_t)y * w + x] = inside ? infinity : 0.f;
+        }
+    }
+
+    Transform2D(toInside, w, h);
+    Transform2D(toOutside, w, h);
+
+    // the outline runs halfway between an inside and an outside pixel, and the
+    // distance to the centre of an output pixel is close to the average over
+    // the samples it covers
+    const float norm = 1.f / ((float)scale * scale * scale);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            float sum = 0.f;
+            for (int sy = 0; sy < scale; sy++) {
+                size_t base = (size_t)(y * scale + sy) * w + (size_t)x * scale;
+                for (int sx = 0; sx < scale; sx++) {
+                    float in = toInside[base + sx];
+                    float out = toOutside[base + sx];
+                    sum += in > 0.f
+                        ? (in >= infinity ? infinity : std::sqrt(in) - 0.5f)
+                        : -(out >= infinity ? infinity : std::sqrt(out) - 0.5f);
+                }
+            }
+            field[(size_t)y * width + x] = sum * norm;
+        }
+    }
+}
+
+void EncodeDistanceField(const float *field, size_t count, float spread, uint8_t *encoded)
+{
+    const float scale = 0.5f / spread;
+    for (size_t i = 0; i < count; i++) {
+        encoded[i] = ToByte(0.5f - field[i] * scale);
+    }
+}
+
+DistanceFieldShader::DistanceFieldShader(float glowWidth, float glowStep, float glowOpacity) :
+    glowWidth(glowWidth), glowStep(glowStep), glowOpacity(glowOpacity)
+{
+    float widest = 1.f;
+    for (float i = 1.f; i <= glowWidth; i += glowStep) {
+        widest = i;
+    }
+    reach = widest / 2 + 0.5f;
+
+    glowTable.resize((size_t)std::ceil(reach * stepsPerPixel) + 1);
+    for (size_t i = 0; i < glowTable.size(); i++) {
+        glowTable[i] = ToByte(GlowAlpha((float)i / stepsPerPixel));
+    }
+}
+
+float DistanceFieldShader::GlowAlpha(float distance) const
+{
+    // a stroke of width w covers the pixels up to w / 2 from the outline
+    float transparent = 1.f;
+    for (float width = 1.f; width <= glowWidth; width += glowStep) {
+        float coverage = std::clamp(width / 2 - std::abs(distance) + 0.5f, 0.f, 1.f);
+        transparent *= 1.f - glowOpacity * coverage;
+    }
+    return 1.f - transparent;
+}
+
+void DistanceFieldShader::Shade(const float *field, size_t count, uint8_t *fill, uint8_t *glow) const
+{
+    for (size_t i = 0; i < count; i++) {
+        float d = field[i];
+        fill[i] = ToByte(0.5f - d);
+
+        float index = std::abs(d) * stepsPerPixel + 0.5f;
+        glow[i] = index < (float)glowTable.size() ? glowTable[(size_t)index] : 0;
+    }
+}
+
+void DistanceFieldShader::GetTransferTables(float spread, size_t size, float *fill, float *glow) const
+{
+    for (size_t i = 0; i < size; i++) {
+        // the inverse of EncodeDistanceField
+        float encoded = (float)i / (size - 1);
+        float d = (0.5f - encoded) * 2.f * spread;
+
+        fill[i] = std::clamp(0.5f - d, 0.f, 1.f);
+        glow[i] = GlowAlpha(d);
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Signed distance fields of glyph masks. The field is generated once per glyph
+// and every effect is a function of the distance to the outline, so a glow of
+// any width costs one lookup per pixel instead of one stroke per step.
+//
+// No platform dependencies, the rasterizer hands in a plain 8-bit mask.
+
+// Signed distance in output pixels from each output pixel to the outline of a
+// binary mask sampled `scale` times finer than the output, negative inside.
+// `mask` is `width * scale` by `height * scale`, non-zero bytes are inside.
+void GenerateDistanceField(const uint8_t *mask, size_t stride, int width, int height, int scale, float *field);
+
+// Stores distances up to `spread` pixels on either side of the outline in one
+// byte each, 128 on the outline and growing inwards. Farther ones are clamped.
+void EncodeDistanceField(const float *field, size_t count, float spread, uint8_t *encoded);
+
+// Turns distances into the fill and glow masks. The glow matches the strokes of
+// increasing width piled over each other, as GlowTextRenderer draws them from
+// geometry: widths 1, 1 + step, ... up to `width`, each with `opacity`.
+class DistanceFieldShader
+{
+public:
+    DistanceFieldShader(float glowWidth, float glowStep, float glowOpacity);
+
+    // pixels outside of the field up to this distance still have glow
+    float GetReach() const
+    {
+        return reach;
+    }
+
+    void Shade(const float *field, size_t count, uint8_t *fill, uint8_t *glow) const;
+
+    // the same as lookup tables over the encoded distances, `size` evenly spaced
+    // entries from byte 0 to byte 255 of a field encoded with `spread`. Values
+    // in between are meant to be interpolated, like a table transfer effect does.
+    void GetTransferTables(float spread, size_t size, float *fill, float *glow) const;
+
+private:
+    static constexpr int stepsPerPixel = 16;
+
+    float GlowAlpha(float distance) const;
+
+    float glowWidth, glowStep, glowOpacity;
+
+    // alpha of the glow by |distance| in 1/16 pixels
+    std::vector<uint8_t> glowTable;
+    float reach;
+};
@@ -1,19 +1,55 @@
 #include "GlowTextRenderer.h"
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 #include "logging.h"
 
 using namespace Microsoft::WRL;
 
-// The constructor stores the Direct2D factory and device context
+namespace {
+// entries of the transfer tables, 1/16 pixel apart with the spread of the atlas
+constexpr size_t transferTableSize = 256;
+
+// maps the alpha of the input through `alpha`, the color is `color` everywhere
+ComPtr<ID2D1Effect> CreateTransfer(ID2D1DeviceContext *context, const std::vector<float> &alpha, D2D1_COLOR_F color)
+{
+    ComPtr<ID2D1Effect> effect;
+    ThrowIfFailed(
+        context->CreateEffect(CLSID_D2D1TableTransfer, &effect)
+    );
+
+    float red[] = { color.r, color.r };
+    float green[] = { color.g, color.g };
+    float blue[] = { color.b, color.b };
+
+    ThrowIfFailed(effect->SetValue(D2D1_TABLETRANSFER_PROP_RED_TABLE, (const BYTE *)red, sizeof(red)));
+    ThrowIfFailed(effect->SetValue(D2D1_TABLETRANSFER_PROP_GREEN_TABLE, (const BYTE *)green, sizeof(green)));
+    ThrowIfFailed(effect->SetValue(D2D1_TABLETRANSFER_PROP_BLUE_TABLE, (const BYTE *)blue, sizeof(blue)));
+    ThrowIfFailed(effect->SetValue(D2D1_TABLETRANSFER_PROP_ALPHA_TABLE, (const BYTE *)alpha.data(),
+                                   (UINT32)(alpha.size() * sizeof(float))));
+    ThrowIfFailed(effect->SetValue(D2D1_TABLETRANSFER_PROP_CLAMP_OUTPUT, TRUE));
+
+    return effect;
+}
+}
+
+// The constructor stores the Direct2D factory and device contexts
 // and creates resources the renderer will use.
 GlowTextRenderer::GlowTextRenderer(
     ComPtr<ID2D1Factory> d2dFactory,
     ComPtr<ID2D1DeviceContext4> d2dDeviceContext,
-    D2D1::ColorF color, float glowWidth, float glowStep
+    ComPtr<ID2D1DeviceContext> glowContext,
+    float glowWidth, float glowStep, float glowOpacity,
+    std::shared_ptr<GlyphAtlas> glyphAtlas
 ) :
     m_refCount(0),
     m_d2dFactory(d2dFactory),
     m_d2dDeviceContext(d2dDeviceContext),
+    m_glowContext(glowContext),
+    m_glyphCache(glyphAtlas ? glyphAtlas->GetOutlines() : std::make_shared<GlyphOutlineCache>(d2dFactory)),
+    m_glyphAtlas(glyphAtlas),
     m_glowWidth(glowWidth),
     m_glowStep(glowStep)
 {
@@ -25,10 +61,6 @@ GlowTextRenderer::GlowTextRenderer(
         )
     );
 
-    ThrowIfFailed(
-        m_d2dFactory->CreatePathGeometry(&m_pathGeometry)
-    );
-
     ThrowIfFailed(
         m_d2dFactory->CreateStrokeStyle(
             D2D1::StrokeStyleProperties(
@@ -42,11 +74,6 @@ GlowTextRenderer::GlowTextRenderer(
         )
     );
 
-    ID2D1SimplifiedGeometrySink **sinkPrt = &m_geometrySink;
-    ThrowIfFailed(
-        m_pathGeometry->Open((ID2D1GeometrySink **)sinkPrt)
-    );
-
     ThrowIfFailed(
         m_d2dDeviceContext->CreateSolidColorBrush(
             D2D1::ColorF(D2D1::ColorF::White),
@@ -54,19 +81,43 @@ GlowTextRenderer::GlowTextRenderer(
         )
     );
 
+    // only the alpha ends up in the glow mask
     ThrowIfFailed(
-        m_d2dDeviceContext->CreateSolidColorBrush(
-            color,
+        m_glowContext->CreateSolidColorBrush(
+            D2D1::ColorF(D2D1::ColorF::White, glowOpacity),
             &m_glowBrush
         )
     );
 
+    // the opacity of the glow is in the atlas masks
+    ThrowIfFailed(
+        m_glowContext->CreateSolidColorBrush(
+            D2D1::ColorF(D2D1::ColorF::White),
+            &m_glowMaskBrush
+        )
+    );
+
     ThrowIfFailed(
         m_d2dDeviceContext->CreateSolidColorBrush(
             D2D1::ColorF(D2D1::ColorF::Black),
             &m_tempBrush
         )
     );
+
+    if (m_glyphAtlas && m_glyphAtlas->GetMode() == GlyphAtlas::Mode::DistanceField) {
+        DistanceFieldShader shader(glowWidth, glowStep, glowOpacity);
+
+        // the field does not reach far enough for a wider glow, draw from geometry
+        if (shader.GetReach() > GlyphAtlas::fieldSpread) {
+            m_glyphAtlas = nullptr;
+        } else {
+            std::vector<float> fill(transferTableSize), glow(transferTableSize);
+            shader.GetTransferTables(GlyphAtlas::fieldSpread, transferTableSize, fill.data(), glow.data());
+
+            m_fillTransfer = CreateTransfer(m_d2dDeviceContext.Get(), fill, m_outlineBrush->GetColor());
+            m_glowTransfer = CreateTransfer(m_glowContext.Get(), glow, D2D1::ColorF(D2D1::ColorF::White));
+        }
+    }
 }
 
 // Decomposes the received glyph run into smaller color glyph runs
@@ -108,55 +159,68 @@ HRESULT GlowTextRenderer::DrawGlyphRun(
         &glyphRunEnumerator
     );
 
-    if (hr == DWRITE_E_NOCOLOR) {
-        // Create the path geometry.
-        ComPtr<ID2D1PathGeometry> pathGeometry;
-        ThrowIfFailed(
-            m_d2dFactory->CreatePathGeometry(&pathGeometry)
-        );
+    // the glow is placed like the fill
+    D2D1_MATRIX_3X2_F transform;
+    m_d2dDeviceContext->GetTransform(&transform);
+    m_glowContext->SetTransform(transform);
+
+    if (hr == DWRITE_E_NOCOLOR && m_glyphAtlas && DrawGlyphRunFromAtlas(baselineOriginX, baselineOriginY, glyphRun)) {
+        // drawn from the masks
+    } else if (hr == DWRITE_E_NOCOLOR) {
+        ComPtr<ID2D1Geometry> geometry = GetGlyphRunGeometry(baselineOriginX, baselineOriginY, glyphRun);
+
+        if (!geometry) {
+            // Create the path geometry.
+            ComPtr<ID2D1PathGeometry> pathGeometry;
+            ThrowIfFailed(
+                m_d2dFactory->CreatePathGeometry(&pathGeometry)
+            );
 
-        // Write to the path geometry using the geometry sink.
-        ComPtr<ID2D1GeometrySink> sink;
-        ThrowIfFailed(
-            pathGeometry->Open(&sink)
-        );
+            // Write to the path geometry using the geometry sink.
+            ComPtr<ID2D1GeometrySink> sink;
+            ThrowIfFailed(
+                pathGeometry->Open(&sink)
+            );
 
-        ThrowIfFailed(
-            glyphRun->fontFace->GetGlyphRunOutline(
-                glyphRun->fontEmSize,
-                glyphRun->glyphIndices,
-                glyphRun->glyphAdvances,
-                glyphRun->glyphOffsets,
-                glyphRun->glyphCount,
-                glyphRun->isSideways,
-                glyphRun->bidiLevel % 2,
-                sink.Get()
-            )
-        );
+            ThrowIfFailed(
+                glyphRun->fontFace->GetGlyphRunOutline(
+                    glyphRun->fontEmSize,
+                    glyphRun->glyphIndices,
+                    glyphRun->glyphAdvances,
+                    glyphRun->glyphOffsets,
+                    glyphRun->glyphCount,
+                    glyphRun->isSideways,
+                    glyphRun->bidiLevel % 2,
+                    sink.Get()
+                )
+            );
 
-        ThrowIfFailed(sink->Close());
+            ThrowIfFailed(sink->Close());
 
-        // Initialize a matrix to translate the origin of the glyph run.
-        D2D1::Matrix3x2F const matrix = D2D1::Matrix3x2F(
-            1.0f, 0.0f,
-            0.0f, 1.0f,
-            baselineOriginX, baselineOriginY
-        );
+            // Initialize a matrix to translate the origin of the glyph run.
+            D2D1::Matrix3x2F const matrix = D2D1::Matrix3x2F(
+                1.0f, 0.0f,
+                0.0f, 1.0f,
+                baselineOriginX, baselineOriginY
+            );
 
-        // Create the transformed geometry
-        ComPtr<ID2D1TransformedGeometry> transformedGeometry;
-        ThrowIfFailed(
-            m_d2dFactory->CreateTransformedGeometry(
-                pathGeometry.Get(),
-                &matrix,
-                &transformedGeometry
-            )
-        );
+            // Create the transformed geometry
+            ComPtr<ID2D1TransformedGeometry> transformedGeometry;
+            ThrowIfFailed(
+                m_d2dFactory->CreateTransformedGeometry(
+                    pathGeometry.Get(),
+                    &matrix,
+                    &transformedGeometry
+                )
+            );
+
+            geometry = transformedGeometry;
+        }
 
         // Draw the outline of the glyph run
-        for (float i = 1.f; i <= m_glowWidth; i += 4.f) {
-            m_d2dDeviceContext->DrawGeometry(
-                transformedGeometry.Get(),
+        for (float i = 1.f; i <= m_glowWidth; i += m_glowStep) {
+            m_glowContext->DrawGeometry(
+                geometry.Get(),
                 m_glowBrush.Get(),
                 i, m_strokeStyle.Get()
             );
@@ -164,7 +228,7 @@ HRESULT GlowTextRenderer::DrawGlyphRun(
 
         // Fill in the glyph run
         m_d2dDeviceContext->FillGeometry(
-            transformedGeometry.Get(),
+            geometry.Get(),
             m_outlineBrush.Get()
         );
 
@@ -252,6 +316,188 @@ HRESULT GlowTextRenderer::DrawGlyphRun(
     return hr;
 }
 
+bool GlowTextRenderer::DrawGlyphRunFromAtlas(
+    FLOAT baselineOriginX,
+    FLOAT baselineOriginY,
+    DWRITE_GLYPH_RUN const *glyphRun
+)
+{
+    if (glyphRun->isSideways || !glyphRun->glyphAdvances) {
+        return false;
+    }
+
+    // the masks are in pixels, they can only be moved but not scaled
+    float dpiX, dpiY;
+    m_d2dDeviceContext->GetDpi(&dpiX, &dpiY);
+
+    D2D1_MATRIX_3X2_F transform;
+    m_d2dDeviceContext->GetTransform(&transform);
+
+    if (dpiX != 96.f || dpiY != 96.f
+        || transform._11 != 1.f || transform._12 != 0.f || transform._21 != 0.f || transform._22 != 1.f) {
+        return false;
+    }
+
+    struct Placed
+    {
+        GlyphAtlas::Glyph glyph;
+        D2D1_RECT_F dest;
+    };
+
+    thread_local std::vector<Placed> placed;
+    placed.clear();
+
+    const bool rightToLeft = glyphRun->bidiLevel % 2;
+
+    float advance = 0.f;
+    for (UINT32 i = 0; i < glyphRun->glyphCount; i++) {
+        float glyphAdvance = glyphRun->glyphAdvances[i];
+        float advanceOffset = glyphRun->glyphOffsets ? glyphRun->glyphOffsets[i].advanceOffset : 0.f;
+        float ascenderOffset = glyphRun->glyphOffsets ? glyphRun->glyphOffsets[i].ascenderOffset : 0.f;
+
+        float x = rightToLeft
+            ? baselineOriginX - advance - glyphAdvance - advanceOffset
+            : baselineOriginX + advance + advanceOffset;
+        float y = baselineOriginY - ascenderOffset;
+        advance += glyphAdvance;
+
+        // whole pixels vertically, a few steps between pixels horizontally
+        float penX = x + transform._31;
+        float pixelX = std::floor(penX);
+        int subpixel = std::min((int)((penX - pixelX) * GlyphAtlas::subpixelSteps), GlyphAtlas::subpixelSteps - 1);
+        float pixelY = std::round(y + transform._32);
+
+        GlyphAtlas::Glyph glyph;
+        if (!m_glyphAtlas->GetGlyph(glyphRun->fontFace, glyphRun->glyphIndices[i], glyphRun->fontEmSize, subpixel, glyph)) {
+            return false;
+        }
+
+        if (!glyph.page) {
+            continue;
+        }
+
+        float left = pixelX + glyph.left - transform._31;
+        float top = pixelY + glyph.top - transform._32;
+        D2D1_RECT_F dest = D2D1::RectF(
+            left, top,
+            left + (glyph.glow.right - glyph.glow.left),
+            top + (glyph.glow.bottom - glyph.glow.top)
+        );
+
+        placed.push_back({ std::move(glyph), dest });
+    }
+
+    if (m_glyphAtlas->GetMode() == GlyphAtlas::Mode::DistanceField) {
+        // one lookup per pixel of the field, the page is only switched when it changes
+        auto drawFields = [&](ID2D1DeviceContext *context, ID2D1Effect *transfer) {
+            ID2D1Bitmap1 *input = nullptr;
+            for (const auto &p : placed) {
+                if (p.glyph.page.Get() != input) {
+                    input = p.glyph.page.Get();
+                    transfer->SetInput(0, input);
+                }
+                context->DrawImage(transfer, D2D1::Point2F(p.dest.left, p.dest.top), p.glyph.glow,
+                                   D2D1_INTERPOLATION_MODE_NEAREST_NEIGHBOR);
+            }
+            transfer->SetInput(0, nullptr);
+        };
+
+        // the glows of neighbouring glyphs overlap, keep the stronger one
+        m_glowContext->SetPrimitiveBlend(D2D1_PRIMITIVE_BLEND_MAX);
+        drawFields(m_glowContext.Get(), m_glowTransfer.Get());
+        m_glowContext->SetPrimitiveBlend(D2D1_PRIMITIVE_BLEND_SOURCE_OVER);
+
+        drawFields(m_d2dDeviceContext.Get(), m_fillTransfer.Get());
+        placed.clear();
+
+        return true;
+    }
+
+    // FillOpacityMask only works without antialiasing, the masks carry their own
+    auto antialiasMode = m_d2dDeviceContext->GetAntialiasMode();
+    m_d2dDeviceContext->SetAntialiasMode(D2D1_ANTIALIAS_MODE_ALIASED);
+    m_glowContext->SetAntialiasMode(D2D1_ANTIALIAS_MODE_ALIASED);
+
+    // the glows of neighbouring glyphs overlap, keep the stronger one instead
+    // of blending them twice
+    m_glowContext->SetPrimitiveBlend(D2D1_PRIMITIVE_BLEND_MAX);
+    for (const auto &p : placed) {
+        m_glowContext->FillOpacityMask(p.glyph.page.Get(), m_glowMaskBrush.Get(), &p.dest, &p.glyph.glow);
+    }
+    m_glowContext->SetPrimitiveBlend(D2D1_PRIMITIVE_BLEND_SOURCE_OVER);
+
+    for (const auto &p : placed) {
+        m_d2dDeviceContext->FillOpacityMask(p.glyph.page.Get(), m_outlineBrush.Get(), &p.dest, &p.glyph.fill);
+    }
+
+    m_d2dDeviceContext->SetAntialiasMode(antialiasMode);
+    m_glowContext->SetAntialiasMode(antialiasMode);
+    placed.clear();
+
+    return true;
+}
+
+ComPtr<ID2D1Geometry> GlowTextRenderer::GetGlyphRunGeometry(
+    FLOAT baselineOriginX,
+    FLOAT baselineOriginY,
+    DWRITE_GLYPH_RUN const *glyphRun
+)
+{
+    // vertical runs are rare, they go through GetGlyphRunOutline as before
+    if (glyphRun->isSideways || !glyphRun->glyphAdvances || glyphRun->glyphCount == 0) {
+        return nullptr;
+    }
+
+    const bool rightToLeft = glyphRun->bidiLevel % 2;
+
+    std::vector<ComPtr<ID2D1TransformedGeometry>> pieces;
+    std::vector<ID2D1Geometry *> geometries;
+    pieces.reserve(glyphRun->glyphCount);
+    geometries.reserve(glyphRun->glyphCount);
+
+    float advance = 0.f;
+    for (UINT32 i = 0; i < glyphRun->glyphCount; i++) {
+        auto outline = m_glyphCache->GetOutline(glyphRun->fontFace, glyphRun->glyphIndices[i], glyphRun->fontEmSize);
+
+        float glyphAdvance = glyphRun->glyphAdvances[i];
+        float advanceOffset = glyphRun->glyphOffsets ? glyphRun->glyphOffsets[i].advanceOffset : 0.f;
+        float ascenderOffset = glyphRun->glyphOffsets ? glyphRun->glyphOffsets[i].ascenderOffset : 0.f;
+
+        // a right-to-left run grows to the left of its origin, the offsets point the same way
+        float x = rightToLeft
+            ? baselineOriginX - advance - glyphAdvance - advanceOffset
+            : baselineOriginX + advance + advanceOffset;
+        float y = baselineOriginY - ascenderOffset;
+        advance += glyphAdvance;
+
+        D2D1::Matrix3x2F const matrix = D2D1::Matrix3x2F::Translation(x, y);
+
+        ComPtr<ID2D1TransformedGeometry> piece;
+        ThrowIfFailed(
+            m_d2dFactory->CreateTransformedGeometry(
+                outline.Get(),
+                &matrix,
+                &piece
+            )
+        );
+
+        geometries.push_back(piece.Get());
+        pieces.push_back(std::move(piece));
+    }
+
+    // one geometry for the run, so overlapping glows are not blended twice
+    ComPtr<ID2D1GeometryGroup> group;
+    ThrowIfFailed(
+        m_d2dFactory->CreateGeometryGroup(
+            D2D1_FILL_MODE_WINDING,
+            geometries.data(), (UINT32)geometries.size(),
+            &group
+        )
+    );
+
+    return group;
+}
+
 IFACEMETHODIMP GlowTextRenderer::DrawUnderline(
     _In_opt_ void *clientDrawingContext,
     FLOAT baselineOriginX,
@@ -6,18 +6,27 @@
 #include <dwrite_3.h>
 #include <wrl/client.h>
 
+#include <memory>
+
+#include "GlyphAtlas.h"
 
 //  The IDWriteTextRenderer interface is an input parameter to
 //  IDWriteTextLayout::Draw.  This interfaces defines a number of
 //  callback functions that the client application implements for
 //  custom text rendering.
+//
+//  The text is filled into `d2dDeviceContext`, while the glow goes as coverage
+//  into the A8 target of `glowContext`. The glow is tinted when the mask is
+//  composited, so one pass serves every glow color.
 class GlowTextRenderer : public IDWriteTextRenderer
 {
 public:
     GlowTextRenderer(
         Microsoft::WRL::ComPtr<ID2D1Factory> d2dFactory,
         Microsoft::WRL::ComPtr<ID2D1DeviceContext4> d2dDeviceContext,
-        D2D1::ColorF color, float glowWidth, float glowStep
+        Microsoft::WRL::ComPtr<ID2D1DeviceContext> glowContext,
+        float glowWidth, float glowStep, float glowOpacity,
+        std::shared_ptr<GlyphAtlas> glyphAtlas = nullptr
     );
 
     IFACEMETHOD(IsPixelSnappingDisabled)(
@@ -80,16 +89,40 @@ public:
         );
 
 private:
+    // copies the pre-rasterized masks, or maps the distance fields of the glyphs
+    // through the transfer effects. False if the run cannot be drawn from the atlas.
+    bool DrawGlyphRunFromAtlas(
+        FLOAT baselineOriginX,
+        FLOAT baselineOriginY,
+        DWRITE_GLYPH_RUN const *glyphRun
+    );
+
+    // the outline of a whole run from cached glyphs, null if the run has to be
+    // converted as a whole
+    Microsoft::WRL::ComPtr<ID2D1Geometry> GetGlyphRunGeometry(
+        FLOAT baselineOriginX,
+        FLOAT baselineOriginY,
+        DWRITE_GLYPH_RUN const *glyphRun
+    );
+
     unsigned long                                m_refCount;
     Microsoft::WRL::ComPtr<ID2D1Factory>         m_d2dFactory;
     Microsoft::WRL::ComPtr<IDWriteFactory4>      m_dwriteFactory;
     Microsoft::WRL::ComPtr<ID2D1DeviceContext4>  m_d2dDeviceContext;
+    Microsoft::WRL::ComPtr<ID2D1DeviceContext>   m_glowContext;
     Microsoft::WRL::ComPtr<ID2D1SolidColorBrush> m_outlineBrush;
     Microsoft::WRL::ComPtr<ID2D1SolidColorBrush> m_glowBrush;
+    Microsoft::WRL::ComPtr<ID2D1SolidColorBrush> m_glowMaskBrush;
     Microsoft::WRL::ComPtr<ID2D1SolidColorBrush> m_tempBrush;
     Microsoft::WRL::ComPtr<ID2D1StrokeStyle>     m_strokeStyle;
-    Microsoft::WRL::ComPtr<ID2D1PathGeometry>               m_pathGeometry;
-    Microsoft::WRL::ComPtr<ID2D1SimplifiedGeometrySink>     m_geometrySink;
+
+    std::shared_ptr<GlyphOutlineCache> m_glyphCache;
+    std::shared_ptr<GlyphAtlas> m_glyphAtlas;
+
+    // turn the distances of a field atlas into the fill and the glow, built
+    // from the glow parameters of this renderer
+    Microsoft::WRL::ComPtr<ID2D1Effect> m_fillTransfer;
+    Microsoft::WRL::ComPtr<ID2D1Effect> m_glowTransfer;
 
     float m_glowWidth;
     float m_glowStep;
@@ -0,0 +1,378 @@
+#include "GlyphAtlas.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "hash.h"
+#include "logging.h"
+
+using namespace Microsoft::WRL;
+
+namespace {
+// 4 pages of 1024x1024 A8 are 4MB, far more than the glyphs on screen
+constexpr size_t maxPages = 4;
+
+// the distance fields are generated from masks this much finer than the atlas
+constexpr int fieldScale = 4;
+}
+
+size_t GlyphOutlineCache::KeyHash::operator()(const Key &key) const
+{
+    uint64_t fields[] = {
+        (uint64_t)(uintptr_t)key.fontFace,
+        (uint64_t)key.glyphIndex,
+        (uint64_t)std::hash<float>()(key.emSize),
+    };
+    return (size_t)hash::xxh64(fields, sizeof(fields));
+}
+
+GlyphOutlineCache::GlyphOutlineCache(ComPtr<ID2D1Factory> d2dFactory, size_t maxGlyphs) :
+    m_d2dFactory(d2dFactory),
+    m_maxGlyphs(maxGlyphs)
+{}
+
+ComPtr<ID2D1Geometry> GlyphOutlineCache::GetOutline(IDWriteFontFace *fontFace, UINT16 glyphIndex, FLOAT emSize)
+{
+    Key key{ fontFace, glyphIndex, emSize };
+
+    std::lock_guard _(m_lock);
+
+    auto it = m_glyphs.find(key);
+    if (it != m_glyphs.end()) {
+        return it->second.outline;
+    }
+
+    ComPtr<ID2D1PathGeometry> outline;
+    ThrowIfFailed(
+        m_d2dFactory->CreatePathGeometry(&outline)
+    );
+
+    ComPtr<ID2D1GeometrySink> sink;
+    ThrowIfFailed(
+        outline->Open(&sink)
+    );
+
+    ThrowIfFailed(
+        fontFace->GetGlyphRunOutline(
+            emSize,
+            &glyphIndex,
+            nullptr,
+            nullptr,
+            1,
+            FALSE,
+            FALSE,
+            sink.Get()
+        )
+    );
+
+    ThrowIfFailed(sink->Close());
+
+    // the glyphs seen in toasts are a small set, start over instead of tracking usage
+    if (m_glyphs.size() >= m_maxGlyphs) {
+        m_glyphs.clear();
+    }
+
+    m_glyphs.emplace(key, Entry{ fontFace, outline });
+    return outline;
+}
+
+size_t GlyphAtlas::KeyHash::operator()(const Key &key) const
+{
+    uint64_t fields[] = {
+        (uint64_t)(uintptr_t)key.fontFace,
+        (uint64_t)key.glyphIndex,
+        (uint64_t)std::hash<float>()(key.emSize),
+        (uint64_t)key.subpixel,
+    };
+    return (size_t)hash::xxh64(fields, sizeof(fields));
+}
+
+GlyphAtlas::GlyphAtlas(ComPtr<ID2D1Device> d2dDevice, std::shared_ptr<GlyphOutlineCache> outlines,
+                       float glowWidth, float glowStep, float glowOpacity, Mode mode, UINT32 pageSize) :
+    m_outlines(outlines),
+    m_glowWidth(glowWidth),
+    m_glowStep(glowStep),
+    m_glowOpacity(glowOpacity),
+    m_mode(mode),
+    m_pageSize(pageSize)
+{
+    ThrowIfFailed(
+        DWriteCreateFactory(
+            DWRITE_FACTORY_TYPE_SHARED,
+            __uuidof(IDWriteFactory),
+            &m_dwriteFactory
+        )
+    );
+
+    ThrowIfFailed(
+        d2dDevice->CreateDeviceContext(
+            D2D1_DEVICE_CONTEXT_OPTIONS_NONE,
+            &m_context
+        )
+    );
+
+    ThrowIfFailed(
+        m_context->CreateSolidColorBrush(
+            D2D1::ColorF(D2D1::ColorF::White),
+            &m_brush
+        )
+    );
+
+    ComPtr<ID2D1Factory> d2dFactory;
+    m_context->GetFactory(&d2dFactory);
+
+    // the same strokes as GlowTextRenderer draws from geometry
+    ThrowIfFailed(
+        d2dFactory->CreateStrokeStyle(
+            D2D1::StrokeStyleProperties(
+                D2D1_CAP_STYLE_ROUND,
+                D2D1_CAP_STYLE_ROUND,
+                D2D1_CAP_STYLE_ROUND,
+                D2D1_LINE_JOIN_ROUND,
+                1.f, D2D1_DASH_STYLE_SOLID, 0.f
+            ), nullptr, 0,
+            &m_strokeStyle
+        )
+    );
+}
+
+bool GlyphAtlas::GetGlyph(IDWriteFontFace *fontFace, UINT16 glyphIndex, FLOAT emSize, int subpixel, Glyph &glyph)
+{
+    Key key{ fontFace, glyphIndex, emSize, subpixel };
+
+    std::lock_guard _(m_lock);
+
+    auto it = m_glyphs.find(key);
+    if (it != m_glyphs.end()) {
+        glyph = it->second.glyph;
+        return true;
+    }
+
+    Glyph result = {};
+    bool rendered = m_mode == Mode::DistanceField
+        ? RenderDistanceField(fontFace, glyphIndex, emSize, subpixel, result)
+        : RenderStrokes(fontFace, glyphIndex, emSize, subpixel, result);
+
+    if (!rendered) {
+        return false;
+    }
+
+    m_glyphs.emplace(key, Entry{ fontFace, result });
+    glyph = result;
+    return true;
+}
+
+bool GlyphAtlas::RenderStrokes(IDWriteFontFace *fontFace, UINT16 glyphIndex, FLOAT emSize, int subpixel, Glyph &glyph)
+{
+    auto outline = m_outlines->GetOutline(fontFace, glyphIndex, emSize);
+
+    D2D1_RECT_F bounds;
+    ThrowIfFailed(outline->GetBounds(nullptr, &bounds));
+
+    if (bounds.right <= bounds.left || bounds.bottom <= bounds.top) {
+        glyph = {};
+        return true;
+    }
+
+    // room for half of the widest stroke around the ink
+    float widest = 1.f;
+    for (float i = 1.f; i <= m_glowWidth; i += m_glowStep) {
+        widest = i;
+    }
+    float pad = std::ceil(widest / 2) + 1.f;
+
+    float offsetX = (float)subpixel / subpixelSteps;
+    D2D1_RECT_F box = {
+        std::floor(bounds.left + offsetX) - pad,
+        std::floor(bounds.top) - pad,
+        std::ceil(bounds.right + offsetX) + pad,
+        std::ceil(bounds.bottom) + pad,
+    };
+
+    UINT32 width = (UINT32)(box.right - box.left);
+    UINT32 height = (UINT32)(box.bottom - box.top);
+
+    // glow and fill side by side, with a gap so the samples do not bleed
+    Page *page;
+    D2D1_POINT_2U pos;
+    if (!Allocate(width * 2 + 2, height + 1, page, pos)) {
+        return false;
+    }
+
+    Rasterize(outline.Get(), offsetX, *page, pos, box);
+
+    glyph.page = page->bitmap;
+    glyph.glow = D2D1::RectF((float)pos.x, (float)pos.y, (float)(pos.x + width), (float)(pos.y + height));
+    glyph.fill = D2D1::RectF((float)(pos.x + width + 1), (float)pos.y, (float)(pos.x + width * 2 + 1), (float)(pos.y + height));
+    glyph.left = box.left;
+    glyph.top = box.top;
+    return true;
+}
+
+bool GlyphAtlas::RenderDistanceField(IDWriteFontFace *fontFace, UINT16 glyphIndex, FLOAT emSize, int subpixel, Glyph &glyph)
+{
+    FLOAT advance = 0.f;
+
+    DWRITE_GLYPH_RUN run = {};
+    run.fontFace = fontFace;
+    run.fontEmSize = emSize;
+    run.glyphCount = 1;
+    run.glyphIndices = &glyphIndex;
+    run.glyphAdvances = &advance;
+
+    // an aliased mask of the glyph scaled up, the outline is placed between its
+    // inside and outside pixels
+    float offsetX = (float)subpixel / subpixelSteps;
+    DWRITE_MATRIX transform = { (FLOAT)fieldScale, 0.f, 0.f, (FLOAT)fieldScale, offsetX * fieldScale, 0.f };
+
+    ComPtr<IDWriteGlyphRunAnalysis> analysis;
+    ThrowIfFailed(
+        m_dwriteFactory->CreateGlyphRunAnalysis(
+            &run, 1.f, &transform,
+            DWRITE_RENDERING_MODE_ALIASED,
+            DWRITE_MEASURING_MODE_NATURAL,
+            0.f, 0.f,
+            &analysis
+        )
+    );
+
+    RECT bounds;
+    ThrowIfFailed(analysis->GetAlphaTextureBounds(DWRITE_TEXTURE_ALIASED_1x1, &bounds));
+
+    if (IsRectEmpty(&bounds)) {
+        glyph = {};
+        return true;
+    }
+
+    UINT32 textureWidth = bounds.right - bounds.left;
+    UINT32 textureHeight = bounds.bottom - bounds.top;
+    std::vector<uint8_t> texture((size_t)textureWidth * textureHeight);
+    ThrowIfFailed(analysis->CreateAlphaTexture(DWRITE_TEXTURE_ALIASED_1x1, &bounds, texture.data(), (UINT32)texture.size()));
+
+    // room for the widest glow around the ink
+    float pad = std::ceil(fieldSpread);
+    D2D1_RECT_F box = {
+        std::floor((float)bounds.left / fieldScale) - pad,
+        std::floor((float)bounds.top / fieldScale) - pad,
+        std::ceil((float)bounds.right / fieldScale) + pad,
+        std::ceil((float)bounds.bottom / fieldScale) + pad,
+    };
+
+    UINT32 width = (UINT32)(box.right - box.left);
+    UINT32 height = (UINT32)(box.bottom - box.top);
+
+    Page *page;
+    D2D1_POINT_2U pos;
+    if (!Allocate(width + 1, height + 1, page, pos)) {
+        return false;
+    }
+
+    size_t maskStride = (size_t)width * fieldScale;
+    std::vector<uint8_t> mask(maskStride * height * fieldScale);
+
+    size_t left = (size_t)(bounds.left - (LONG)box.left * fieldScale);
+    size_t top = (size_t)(bounds.top - (LONG)box.top * fieldScale);
+    for (UINT32 y = 0; y < textureHeight; y++) {
+        std::copy_n(&texture[(size_t)y * textureWidth], textureWidth, &mask[(top + y) * maskStride + left]);
+    }
+
+    size_t count = (size_t)width * height;
+    std::vector<float> field(count);
+    GenerateDistanceField(mask.data(), maskStride, width, height, fieldScale, field.data());
+
+    std::vector<uint8_t> encoded(count);
+    EncodeDistanceField(field.data(), count, fieldSpread, encoded.data());
+
+    D2D1_RECT_U fieldRect = D2D1::RectU(pos.x, pos.y, pos.x + width, pos.y + height);
+    ThrowIfFailed(page->bitmap->CopyFromMemory(&fieldRect, encoded.data(), width));
+
+    glyph.page = page->bitmap;
+    glyph.glow = D2D1::RectF((float)fieldRect.left, (float)fieldRect.top, (float)fieldRect.right, (float)fieldRect.bottom);
+    glyph.fill = glyph.glow;
+    glyph.left = box.left;
+    glyph.top = box.top;
+    return true;
+}
+
+bool GlyphAtlas::Allocate(UINT32 width, UINT32 height, Page *&page, D2D1_POINT_2U &pos)
+{
+    if (width > m_pageSize || height > m_pageSize) {
+        return false;
+    }
+
+    if (!m_pages.empty()) {
+        Page &last = m_pages.back();
+        if (last.x + width > m_pageSize) {
+            last.x = 0;
+            last.y += last.shelfHeight;
+            last.shelfHeight = 0;
+        }
+
+        if (last.y + height <= m_pageSize) {
+            pos = D2D1::Point2U(last.x, last.y);
+            last.x += width;
+            last.shelfHeight = std::max(last.shelfHeight, height);
+            page = &last;
+            return true;
+        }
+    }
+
+    // every page is full, start over. Glyphs already handed out keep their page alive.
+    if (m_pages.size() >= maxPages) {
+        DBG << "Glyph atlas is full, dropping " << m_glyphs.size() << " glyphs";
+        m_pages.clear();
+        m_glyphs.clear();
+    }
+
+    Page fresh;
+    ThrowIfFailed(
+        m_context->CreateBitmap(
+            D2D1::SizeU(m_pageSize, m_pageSize),
+            nullptr, 0,
+            D2D1_BITMAP_PROPERTIES1{
+                { DXGI_FORMAT_A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED },
+                96.f, 96.f,
+                D2D1_BITMAP_OPTIONS_TARGET
+            },
+            &fresh.bitmap
+        )
+    );
+
+    m_context->SetTarget(fresh.bitmap.Get());
+    m_context->BeginDraw();
+    m_context->Clear(D2D1::ColorF(0, 0.f));
+    ThrowIfFailed(m_context->EndDraw());
+    m_context->SetTarget(nullptr);
+
+    m_pages.push_back(std::move(fresh));
+
+    Page &last = m_pages.back();
+    pos = D2D1::Point2U(0, 0);
+    last.x = width;
+    last.shelfHeight = height;
+    page = &last;
+    return true;
+}
+
+void GlyphAtlas::Rasterize(ID2D1Geometry *outline, float offsetX, Page &page, D2D1_POINT_2U pos, const D2D1_RECT_F &box)
+{
+    float width = box.right - box.left;
+
+    m_context->SetTarget(page.bitmap.Get());
+    m_context->BeginDraw();
+
+    // the strokes pile up like they do when drawn over the toast
+    m_context->SetTransform(D2D1::Matrix3x2F::Translation(pos.x - box.left + offsetX, pos.y - box.top));
+    m_brush->SetOpacity(m_glowOpacity);
+    for (float i = 1.f; i <= m_glowWidth; i += m_glowStep) {
+        m_context->DrawGeometry(outline, m_brush.Get(), i, m_strokeStyle.Get());
+    }
+
+    m_context->SetTransform(D2D1::Matrix3x2F::Translation(pos.x + width + 1 - box.left + offsetX, pos.y - box.top));
+    m_brush->SetOpacity(1.f);
+    m_context->FillGeometry(outline, m_brush.Get());
+
+    m_context->SetTransform(D2D1::IdentityMatrix());
+    ThrowIfFailed(m_context->EndDraw());
+    m_context->SetTarget(nullptr);
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <d2d1_3.h>
+#include <dwrite.h>
+#include <wrl/client.h>
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "DistanceField.h"
+
+// Outlines of single glyphs at the origin, keyed by font face, glyph index and
+// em size. Runs are put together from the cached pieces, so every glyph is
+// converted to a path only once. Shared by the renderers of one device.
+class GlyphOutlineCache
+{
+public:
+    GlyphOutlineCache(Microsoft::WRL::ComPtr<ID2D1Factory> d2dFactory, size_t maxGlyphs = 4096);
+
+    Microsoft::WRL::ComPtr<ID2D1Geometry> GetOutline(IDWriteFontFace *fontFace, UINT16 glyphIndex, FLOAT emSize);
+
+private:
+    struct Key
+    {
+        IDWriteFontFace *fontFace;
+        UINT16 glyphIndex;
+        FLOAT emSize;
+
+        bool operator==(const Key &other) const
+        {
+            return fontFace == other.fontFace && glyphIndex == other.glyphIndex && emSize == other.emSize;
+        }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key &key) const;
+    };
+
+    struct Entry
+    {
+        // keeps the face, and so the key, alive
+        Microsoft::WRL::ComPtr<IDWriteFontFace> fontFace;
+        Microsoft::WRL::ComPtr<ID2D1PathGeometry> outline;
+    };
+
+    Microsoft::WRL::ComPtr<ID2D1Factory> m_d2dFactory;
+
+    std::mutex m_lock;
+    std::unordered_map<Key, Entry, KeyHash> m_glyphs;
+    size_t m_maxGlyphs;
+};
+
+// Fill and glow masks of glyphs rasterized once and packed into A8 pages.
+// Text is then drawn by tinting the masks with FillOpacityMask, so the glow
+// strokes are not repeated for every toast, and both glow colors share the
+// masks as long as they have the same opacity.
+//
+// In the distance field mode the page keeps the signed distance field of each
+// glyph instead, encoded with EncodeDistanceField. The renderer maps it to the
+// fill and the glow when drawing, so the glow width, step and opacity are not
+// baked in and any glow within `fieldSpread` of the ink costs the same.
+class GlyphAtlas
+{
+public:
+    enum class Mode
+    {
+        Strokes,
+        DistanceField,
+    };
+
+    // horizontal pen positions are rounded to this fraction of a pixel
+    static constexpr int subpixelSteps = 4;
+
+    // distances are kept this far around the ink, enough for glows up to 15 wide
+    static constexpr float fieldSpread = 8.f;
+
+    struct Glyph
+    {
+        // null for glyphs without ink, like spaces
+        Microsoft::WRL::ComPtr<ID2D1Bitmap1> page;
+
+        // source rectangles in the page, both masks have the same size. Both
+        // are the field in the distance field mode.
+        D2D1_RECT_F fill;
+        D2D1_RECT_F glow;
+
+        // top left of the masks relative to the pixel of the pen position
+        float left;
+        float top;
+    };
+
+    // the glow parameters are only used by the Strokes mode
+    GlyphAtlas(Microsoft::WRL::ComPtr<ID2D1Device> d2dDevice, std::shared_ptr<GlyphOutlineCache> outlines,
+               float glowWidth, float glowStep, float glowOpacity, Mode mode = Mode::Strokes, UINT32 pageSize = 1024);
+
+    // false if the glyph is too large for a page, it has to be drawn as geometry
+    bool GetGlyph(IDWriteFontFace *fontFace, UINT16 glyphIndex, FLOAT emSize, int subpixel, Glyph &glyph);
+
+    std::shared_ptr<GlyphOutlineCache> GetOutlines() const
+    {
+        return m_outlines;
+    }
+
+    Mode GetMode() const
+    {
+        return m_mode;
+    }
+
+private:
+    struct Key
+    {
+        IDWriteFontFace *fontFace;
+        UINT16 glyphIndex;
+        FLOAT emSize;
+        int subpixel;
+
+        bool operator==(const Key &other) const
+        {
+            return fontFace == other.fontFace && glyphIndex == other.glyphIndex
+                && emSize == other.emSize && subpixel == other.subpixel;
+        }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key &key) const;
+    };
+
+    struct Entry
+    {
+        Microsoft::WRL::ComPtr<IDWriteFontFace> fontFace;
+        Glyph glyph;
+    };
+
+    // shelf packing, a new shelf is started when the current one is full
+    struct Page
+    {
+        Microsoft::WRL::ComPtr<ID2D1Bitmap1> bitmap;
+        UINT32 x = 0;
+        UINT32 y = 0;
+        UINT32 shelfHeight = 0;
+    };
+
+    // both fill `glyph`, false if it does not fit into a page
+    bool RenderStrokes(IDWriteFontFace *fontFace, UINT16 glyphIndex, FLOAT emSize, int subpixel, Glyph &glyph);
+    bool RenderDistanceField(IDWriteFontFace *fontFace, UINT16 glyphIndex, FLOAT emSize, int subpixel, Glyph &glyph);
+
+    bool Allocate(UINT32 width, UINT32 height, Page *&page, D2D1_POINT_2U &pos);
+    void Rasterize(ID2D1Geometry *outline, float offsetX, Page &page, D2D1_POINT_2U pos, const D2D1_RECT_F &box);
+
+    std::shared_ptr<GlyphOutlineCache> m_outlines;
+    Microsoft::WRL::ComPtr<IDWriteFactory> m_dwriteFactory;
+
+    // only draws into the pages, the masks are used by the device contexts of the same device
+    Microsoft::WRL::ComPtr<ID2D1DeviceContext>   m_context;
+    Microsoft::WRL::ComPtr<ID2D1SolidColorBrush> m_brush;
+    Microsoft::WRL::ComPtr<ID2D1StrokeStyle>     m_strokeStyle;
+
+    float m_glowWidth;
+    float m_glowStep;
+    float m_glowOpacity;
+    Mode m_mode;
+    UINT32 m_pageSize;
+
+    std::mutex m_lock;
+    std::vector<Page> m_pages;
+    std::unordered_map<Key, Entry, KeyHash> m_glyphs;
+};
@@ -13,6 +13,7 @@
 #include <thread>
 
 #include "ActionCenter.h"
+#include "LayeredRender.h"
 #include "Win32Application.h"
 
 #pragma comment(lib, "Winhttp.lib")
@@ -147,10 +148,10 @@ std::vector<uint8_t> HttpClient(const char *verb, const std::wstring &url)
     return buffer;
 }
 
-Image DownloadImage(const std::wstring &url)
+// "linear" averages in linear light, anything else keeps the plain sRGB filter
+static Image::ResizeMode ParseResizeMode(const std::string &mode)
 {
-    auto buffer = HttpClient("GET", url);
-    return Image::open(buffer.data(), buffer.size());
+    return mode == "linear" ? Image::LinearLight : Image::Naive;
 }
 
 static void HttpMain()
@@ -168,13 +169,20 @@ static void HttpMain()
 
         Toast toast;
 
-        toast.title = std::u8tow(req.get_param_value("title"));
-        toast.text = std::u8tow(req.get_param_value("text"));
+        toast.title = Intern(req.get_param_value("title"));
+        toast.text = Intern(req.get_param_value("text"));
+        toast.resizeMode = ParseResizeMode(req.get_param_value("resize"));
         if (req.has_param("imageurl")) {
-            toast.image = DownloadImage(std::u8tow(req.get_param_value("imageurl")));
+            auto buffer = HttpClient("GET", std::u8tow(req.get_param_value("imageurl")));
+            auto im = actionCenter.OpenImage(
+                std::string_view((const char *)buffer.data(), buffer.size()),
+                [&] { return std::move(buffer); },
+                toast.resizeMode);
+
+            toast.image = std::move(im);
         }
 
-        toast.link = std::u8tow(req.get_param_value("link"));
+        toast.link = Intern(req.get_param_value("link"));
 
         int toastId = actionCenter.AddToast(std::move(toast));
         if (toastId == -1) {
@@ -230,41 +238,50 @@ static void HttpMain()
             return;
         }
 
-        std::string link = data["link"].get<std::string>();
+        std::string link;
         if (data.find("link") != data.end()) {
             link = data["link"].get<std::string>();
         }
 
-        Image im;
-        if (encoded.size()) {
-            uint8_t *image = (uint8_t *)_aligned_malloc(base64::decoded_size(encoded.length()), 512);
-            if (image == nullptr) {
-                res.set_content(R"({"status": "error", "msg": "unable allocate memory"})", "application/json");
-                return;
-            }
-
-            auto [written, read] = base64::decode(image, encoded.data(), encoded.size());
-            if (read == 0) {
-                res.set_content(R"({"status": "error", "msg": "unable to decode base64"})", "application/json");
-                _aligned_free(image);
-                return;
-            }
-
-            im = Image::open(image, written);
-            _aligned_free(image);
+        auto resizeMode = Image::Naive;
+        if (data.find("resize") != data.end()) {
+            resizeMode = ParseResizeMode(data["resize"].get<std::string>());
+        }
 
-            if (im) {
-                res.set_content(R"({"status": "error", "msg": "unable to decode image"})", "application/json");
+        CachedImage im;
+        if (encoded.size()) {
+            std::string error;
+
+            // the cache is keyed by the base64 text, so a repeated payload skips base64 decoding too
+            im = actionCenter.OpenImage(encoded, [&] {
+                std::vector<uint8_t> image(base64::max_decoded_size(encoded.length()));
+
+                auto result = base64::strict_decode(image.data(), encoded.data(), encoded.size());
+                if (!result.ok()) {
+                    error = json{
+                        { "status", "error" },
+                        { "msg", "invalid base64 at offset " + std::to_string(result.error) },
+                    }.dump();
+                    result.written = 0;
+                }
+
+                image.resize(result.written);
+                return image;
+            }, resizeMode);
+
+            if (!im) {
+                res.set_content(error.size() ? error : R"({"status": "error", "msg": "unable to decode image"})", "application/json");
                 return;
             }
         }
 
         int toastId = actionCenter.AddToast(Toast{
             0,
-            std::u8tow(title),
-            std::u8tow(text),
+            Intern(title),
+            Intern(text),
             std::move(im),
-            std::u8tow(link),
+            Intern(link),
+            resizeMode,
         });
 
         if (toastId == -1) {
@@ -277,6 +294,60 @@ static void HttpMain()
         res.set_content(json, "application/json");
     });
 
+    r.Get("/stats", [](const Request &req, Response &res) {
+        auto stats = actionCenter.GetImageCacheStats();
+        auto lookups = stats.hits + stats.misses;
+
+        auto layouts = actionCenter.GetLayoutCacheStats();
+        auto layoutLookups = layouts.hits + layouts.misses;
+
+        auto strings = StringTable::Global().GetStats();
+
+        // the toast list is only written by the render thread, a render thread
+        // that falls behind shows up as command latency instead
+        auto toasts = actionCenter.GetToastListStats();
+        auto commands = actionCenter.GetCommandStats();
+
+        json body = {
+            { "status", "ok" },
+            { "image_cache", {
+                { "hits", stats.hits },
+                { "misses", stats.misses },
+                { "hit_rate", lookups ? (double)stats.hits / lookups : 0.0 },
+                { "entries", stats.entries },
+                { "bytes", stats.bytes },
+                { "budget", stats.budget },
+            } },
+            { "layout_cache", {
+                { "hits", layouts.hits },
+                { "misses", layouts.misses },
+                { "hit_rate", layoutLookups ? (double)layouts.hits / layoutLookups : 0.0 },
+                { "entries", layouts.entries },
+                { "bytes", layouts.bytes },
+                { "budget", layouts.budget },
+            } },
+            { "strings", {
+                { "hits", strings.hits },
+                { "misses", strings.misses },
+                { "entries", strings.entries },
+                { "bytes", strings.bytes },
+            } },
+            { "toast_list", {
+                { "toasts", toasts.size },
+                { "versions", toasts.versions },
+                { "reads", toasts.reads },
+            } },
+            { "commands", {
+                { "applied", commands.applied },
+                { "max_queue_depth", commands.maxQueueDepth },
+                { "mean_latency_ms", commands.applied ? commands.latencyMs / commands.applied : 0.0 },
+                { "max_latency_ms", commands.maxLatencyMs },
+            } },
+        };
+
+        res.set_content(body.dump(), "application/json");
+    });
+
     r.Get("/stop", [](const Request &req, Response &res) {
         DBG << "Stop by HTTP request...";
         PostMessage(Win32Application::GetHwnd(), WM_DESTROY, 0, 0);
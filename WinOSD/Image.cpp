@@ -1,11 +1,20 @@
+#include "Animation.h"
+
 #ifndef USE_OPENCV
 #define STBI_NO_PIC
 #define STBI_NO_HDR
 #define STBI_NO_PNM
 
+#ifdef _WIN32
 #define STBI_MALLOC(sz)         _aligned_malloc(sz, 512)
 #define STBI_REALLOC(p,newsz)   _aligned_realloc(p, newsz, 512)
 #define STBI_FREE(p)            _aligned_free(p)
+#else
+// there is no aligned realloc outside of the MSVC CRT, the alignment is only an optimization
+#define STBI_MALLOC(sz)         malloc(sz)
+#define STBI_REALLOC(p,newsz)   realloc(p, newsz)
+#define STBI_FREE(p)            free(p)
+#endif
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
@@ -16,3 +25,119 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
 #endif
+
+#ifndef USE_OPENCV
+namespace {
+// Steps through a GIF one frame at a time with the stb_image internals,
+// stbi_load_gif_from_memory would decode every frame up front
+class GifFrames : public FrameSource
+{
+public:
+    GifFrames(const uint8_t *data, size_t len, int w, int h) :
+        data(data), len(len)
+    {
+        memset(&gif, 0, sizeof(gif));
+        if (w > 0 && h > 0) {
+            // known from an earlier probe
+            if (rewind()) {
+                width = w;
+                height = h;
+            }
+        } else if (rewind()) {
+            // the logical screen size is known after the first frame
+            int delay;
+            if (next(delay)) {
+                width = gif.w;
+                height = gif.h;
+            }
+        }
+    }
+
+    ~GifFrames()
+    {
+        release();
+    }
+
+    bool animated() override
+    {
+        if (width <= 0 || height <= 0) {
+            return false;
+        }
+
+        // only peek at the second frame, the first one is usually decoded already
+        int delay;
+        if (position != 1 && !(rewind() && next(delay))) {
+            return false;
+        }
+
+        bool ret = next(delay) != nullptr;
+        rewind();
+        return ret;
+    }
+
+    const uint8_t *next(int &delay) override
+    {
+        // canvas before the previous frame, for the "restore to previous" disposal method
+        stbi_uc *twoBack = history[1].empty() ? nullptr : history[1].data();
+
+        int comp;
+        stbi_uc *canvas = stbi__gif_load_next(&ctx, &gif, &comp, 4, twoBack);
+        if (canvas == nullptr || canvas == (stbi_uc *)&ctx) {
+            // (stbi_uc *)&ctx marks the end of the animation
+            return nullptr;
+        }
+
+        size_t size = (size_t)gif.w * gif.h * 4;
+        std::swap(history[0], history[1]);
+        history[0].assign(canvas, canvas + size);
+
+        delay = gif.delay;
+        position++;
+        return canvas;
+    }
+
+    bool rewind() override
+    {
+        release();
+        position = 0;
+
+        stbi__start_mem(&ctx, data, (int)len);
+        return stbi__gif_test(&ctx) != 0;
+    }
+
+private:
+    void release()
+    {
+        STBI_FREE(gif.out);
+        STBI_FREE(gif.history);
+        STBI_FREE(gif.background);
+        memset(&gif, 0, sizeof(gif));
+
+        history[0].clear();
+        history[1].clear();
+    }
+
+    const uint8_t *data;
+    size_t len;
+
+    stbi__context ctx;
+    stbi__gif gif;
+
+    // the last two composed frames
+    std::vector<stbi_uc> history[2];
+
+    // frames decoded since the last rewind
+    int position = 0;
+};
+}
+
+std::unique_ptr<FrameSource> OpenGifFrames(const uint8_t *data, size_t len, int width, int height)
+{
+    auto source = std::make_unique<GifFrames>(data, len, width, height);
+    if (source->width <= 0 || source->height <= 0) {
+        return nullptr;
+    }
+
+    return source;
+}
+#endif
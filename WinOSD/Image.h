@@ -10,9 +10,16 @@
 #define STBI_NO_HDR
 #define STBI_NO_PNM
 
+#ifdef _WIN32
 #define STBI_MALLOC(sz)         _aligned_malloc(sz, 512)
 #define STBI_REALLOC(p,newsz)   _aligned_realloc(p, newsz, 512)
 #define STBI_FREE(p)            _aligned_free(p)
+#else
+// there is no aligned realloc outside of the MSVC CRT, the alignment is only an optimization
+#define STBI_MALLOC(sz)         malloc(sz)
+#define STBI_REALLOC(p,newsz)   realloc(p, newsz)
+#define STBI_FREE(p)            free(p)
+#endif
 
 #include <stb_image.h>
 #include <stb_image_resize.h>
@@ -20,8 +27,12 @@
 #endif
 
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <string>
 
+#include "ImageDecoder.h"
+#include "ImageResize.h"
 #include "logging.h"
 
 namespace {
@@ -52,6 +63,14 @@ public:
         RGB,
     };
 
+    enum ResizeMode
+    {
+        // filter straight on the sRGB values
+        Naive,
+        // average in linear light, keeps thin bright details of screenshots and text
+        LinearLight,
+    };
+
     static Image open(const uint8_t *image_data, size_t len)
     {
         if (len == 0) {
@@ -82,18 +101,17 @@ public:
             im = std::move(rgba);
         }
 
-        return Image(std::move(im));
+        Image result(std::move(im));
 #else
-        int w, h, ch;
-        uint8_t *data = stbi_load_from_memory(image_data, (int)len, &w, &h, &ch, 4);
-        if (data == nullptr) {
-            return Image();
-        }
+        Image result = ImageDecoder::Decode(image_data, len);
+#endif
 
-        // If it dose not have alpha channel, then it should be RGB; otherwise assume it is BGR
+        // the pixels are kept as stored, they are rotated after being fitted which is much cheaper
+        if (result) {
+            result.orientation = ReadJpegOrientation(image_data, len);
+        }
 
-        return Image(data, w, h, 4, ch == 3 ? RGB : BGR);
-#endif
+        return result;
     }
 
     Image() :
@@ -120,44 +138,41 @@ public:
     {}
 #endif
 
-    // don't copy image
-    Image(const Image &other) = delete;
-    Image &operator=(const Image &other) = delete;
-
-    Image(Image &&other) noexcept
+    // allocate an uninitialized image
+    static Image create(int w, int h, int ch, PixelOrder order)
     {
-#ifdef USE_OPENCV
-        if (other.image.empty()) {
-            image = cv::Mat();
-        } else {
-            image = std::move(other.image);
+        if (w <= 0 || h <= 0 || ch <= 0) {
+            return Image();
         }
 
-        order = other.order;
-
-        data = image.data;
-        width = image.cols;
-        height = image.rows;
-        ch = image.channels();
+#ifdef USE_OPENCV
+        return Image(cv::Mat(h, w, CV_MAKE_TYPE(CV_8U, ch)), order);
 #else
-        if (other.data == nullptr) {
-            return;
+        uint8_t *buffer = (uint8_t *)STBI_MALLOC((size_t)w * h * ch);
+        if (buffer == nullptr) {
+            return Image();
         }
 
-        order = other.order;
+        return Image(buffer, w, h, ch, order);
+#endif
+    }
 
-        data = other.data;
-        width = other.width;
-        height = other.height;
-        ch = other.ch;
+    // don't copy image
+    Image(const Image &other) = delete;
+    Image &operator=(const Image &other) = delete;
 
-        other.data = nullptr;
-        return;
-#endif
+    Image(Image &&other) noexcept :
+        Image()
+    {
+        *this = std::move(other);
     }
 
     Image &operator=(Image &&other) noexcept
     {
+        if (this == &other) {
+            return *this;
+        }
+
 #ifdef USE_OPENCV
         if (other.image.empty()) {
             image = cv::Mat();
@@ -166,6 +181,7 @@ public:
         }
 
         order = other.order;
+        orientation = other.orientation;
 
         data = image.data;
         width = image.cols;
@@ -173,11 +189,12 @@ public:
         ch = image.channels();
         return *this;
 #else
-        if (other.data == nullptr) {
-            return *this;
+        if (data) {
+            STBI_FREE(data);
         }
 
         order = other.order;
+        orientation = other.orientation;
 
         data = other.data;
         width = other.width;
@@ -185,12 +202,26 @@ public:
         ch = other.ch;
 
         other.data = nullptr;
+        other.width = other.height = other.ch = 0;
+        other.orientation = 1;
         return *this;
 #endif
     }
 
     ~Image()
-    {}
+    {
+#ifndef USE_OPENCV
+        if (data) {
+            STBI_FREE(data);
+        }
+#endif
+    }
+
+    // bytes held by the pixel buffer
+    size_t size() const
+    {
+        return (size_t)width * height * ch;
+    }
 
     bool opened() const
     {
@@ -233,35 +264,38 @@ public:
 #endif
     }
 
-    Image resize(int w, int h) const
+    Image resize(int w, int h, ResizeMode mode = Naive) const
     {
-#ifdef USE_OPENCV
-        if (image.empty()) {
+        Image resized = create(w, h, ch, order);
+        if (!resized || !resize(resized, mode)) {
             return Image();
         }
 
-        cv::Mat resized;
-        cv::resize(image, resized, { w, h }, 0, 0, cv::INTER_CUBIC);
+        return resized;
+    }
 
-        return Image(std::move(resized));
-#else
-        if (data == nullptr || w <= 0 || h <= 0) {
-            return Image();
+    // resize into a preallocated image, the size of dst is the output size
+    bool resize(Image &dst, ResizeMode mode = Naive) const
+    {
+        if (!opened() || !dst || dst.ch != ch) {
+            return false;
         }
 
-        uint8_t *resized = (uint8_t *)STBI_MALLOC(w * h * ch);
-        if (resized == nullptr) {
-            return Image();
-        }
+        dst.order = order;
+        dst.orientation = orientation;
 
-        auto ret = stbir_resize_uint8(data, width, height, width * ch,
-                                      resized, w, h, w * ch, ch);
-        if (ret == 0) {
-            STBI_FREE(resized);
-            return Image();
+        if (mode == LinearLight &&
+            ResizeLinearLight(data, width, height, (size_t)width * ch,
+                              dst.data, dst.width, dst.height, (size_t)dst.width * ch, ch)) {
+            return true;
         }
 
-        return Image(resized, w, h, ch, order);
+#ifdef USE_OPENCV
+        cv::resize(image, dst.image, dst.image.size(), 0, 0, cv::INTER_CUBIC);
+        return true;
+#else
+        return stbir_resize_uint8(data, width, height, width * ch,
+                                  dst.data, dst.width, dst.height, dst.width * ch, ch) != 0;
 #endif
     }
 
@@ -299,7 +333,7 @@ public:
         }
 
         bitblt(resized, w * ch,
-               data + (width * top + left) * ch, height * ch,
+               data + (width * top + left) * ch, width * ch,
                w * ch, h);
 
         return Image(resized, w, h, ch, order);
@@ -310,6 +344,9 @@ public:
     uint8_t *data;
     int width, height, ch;
 
+    // EXIF orientation of the pixels, 1 is upright
+    int orientation = 1;
+
 private:
 #ifdef USE_OPENCV
     cv::Mat image;
@@ -0,0 +1,99 @@
+#include "ImageCache.h"
+
+#include "logging.h"
+
+ImageCache::ImageCache(size_t budget) :
+    budget(budget)
+{}
+
+ImageCache::~ImageCache()
+{
+    // toasts may still hold the pyramids
+    for (auto &entry : lru) {
+        Release(entry);
+    }
+}
+
+CachedImage ImageCache::Find(uint64_t hash)
+{
+    std::lock_guard _(lock);
+
+    auto it = index.find(hash);
+    if (it == index.end()) {
+        ++misses;
+        return CachedImage();
+    }
+
+    ++hits;
+    lru.splice(lru.begin(), lru, it->second);
+    return it->second->image;
+}
+
+void ImageCache::Insert(uint64_t hash, const CachedImage &im)
+{
+    if (!im) {
+        return;
+    }
+
+    // a single image larger than the whole budget would only flush the cache
+    if (im.size() > budget) {
+        return;
+    }
+
+    std::lock_guard _(lock);
+
+    auto it = index.find(hash);
+    if (it != index.end()) {
+        // another request decoded the same payload concurrently
+        lru.splice(lru.begin(), lru, it->second);
+        return;
+    }
+
+    lru.push_front(Entry{ hash, im });
+    index.emplace(hash, lru.begin());
+
+    if (im.image) {
+        im.image->Attach(&bytes);
+    }
+    if (im.animation) {
+        bytes += im.animation->size();
+    }
+
+    Evict();
+}
+
+void ImageCache::Evict()
+{
+    // unused levels are cheap to rebuild, drop them before whole images
+    for (auto it = lru.rbegin(); bytes > budget && it != lru.rend(); ++it) {
+        if (it->image.image) {
+            it->image.image->Trim();
+        }
+    }
+
+    while (bytes > budget && !lru.empty()) {
+        auto &entry = lru.back();
+        DBG << "Evict cached image " << std::hex << entry.key << std::dec
+            << " (" << entry.image.image->width() << "x" << entry.image.image->height() << ")";
+
+        Release(entry);
+        index.erase(entry.key);
+        lru.pop_back();
+    }
+}
+
+void ImageCache::Release(Entry &entry)
+{
+    if (entry.image.image) {
+        entry.image.image->Attach(nullptr);
+    }
+    if (entry.image.animation) {
+        bytes -= entry.image.animation->size();
+    }
+}
+
+ImageCache::Stats ImageCache::GetStats() const
+{
+    std::lock_guard _(lock);
+    return Stats{ hits, misses, lru.size(), bytes.load(), budget };
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "ImagePyramid.h"
+
+struct CachedImage
+{
+    // the first frame of an animation
+    std::shared_ptr<ImagePyramid> image;
+
+    // encoded bytes of an animated image, the frames are decoded lazily from it
+    std::shared_ptr<const std::vector<uint8_t>> animation;
+
+    // found out once on a cache miss, toasts open the animation without probing its frames
+    bool animated = false;
+    int frameWidth = 0;
+    int frameHeight = 0;
+
+    size_t size() const
+    {
+        return (image ? image->size() : 0) + (animation ? animation->size() : 0);
+    }
+
+    explicit operator bool() const
+    {
+        return image && *image;
+    }
+};
+
+// LRU of decoded images keyed by the hash of the encoded payload. The pyramids
+// grow when a toast asks for a new size and report it to the running total of
+// the cache, unused levels are dropped before whole images are evicted.
+class ImageCache
+{
+public:
+    struct Stats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        size_t entries;
+        size_t bytes;
+        size_t budget;
+    };
+
+    ImageCache(size_t budget = 64 * 1024 * 1024);
+    ~ImageCache();
+
+    CachedImage Find(uint64_t hash);
+    void Insert(uint64_t hash, const CachedImage &im);
+
+    Stats GetStats() const;
+
+private:
+    struct KeyHash
+    {
+        size_t operator()(uint64_t hash) const
+        {
+            // the content hash is already well mixed
+            return (size_t)hash;
+        }
+    };
+
+    struct Entry
+    {
+        uint64_t key;
+        CachedImage image;
+    };
+
+    void Evict();
+    void Release(Entry &entry);
+
+    mutable std::mutex lock;
+
+    // front is the most recently used
+    std::list<Entry> lru;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator, KeyHash> index;
+
+    size_t budget;
+
+    // pyramids of the cached entries add the levels they build
+    std::atomic<size_t> bytes = 0;
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
@@ -0,0 +1,369 @@
+#include "ImageDecoder.h"
+#include "Image.h"
+
+#include "logging.h"
+#include "timer.h"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#ifdef USE_OPENCV
+// OpenCV decodes everything by itself, the native codecs need the stb allocator
+#undef USE_LIBJPEG_TURBO
+#undef USE_LIBSPNG
+#undef USE_LIBWEBP
+#endif
+
+#ifdef USE_LIBJPEG_TURBO
+#include <turbojpeg.h>
+#pragma comment(lib, "turbojpeg-static.lib")
+#endif
+
+#ifdef USE_LIBSPNG
+#include <spng.h>
+#pragma comment(lib, "spng_static.lib")
+#endif
+
+#ifdef USE_LIBWEBP
+#include <webp/decode.h>
+#pragma comment(lib, "libwebp.lib")
+#endif
+
+namespace {
+struct DecoderEntry
+{
+    ImageFormat format;
+    const char *name;
+    ImageDecoder::DecodeFunc decode;
+    int priority;
+};
+
+// anything larger is most likely a decompression bomb
+constexpr int maxImageDimension = 16384;
+
+#ifndef USE_OPENCV
+Image DecodeStb(const uint8_t *data, size_t len)
+{
+    int w, h, ch;
+    uint8_t *pixels = stbi_load_from_memory(data, (int)len, &w, &h, &ch, 4);
+    if (pixels == nullptr) {
+        DBG << "stb_image: " << stbi_failure_reason();
+        return Image();
+    }
+
+    // If it dose not have alpha channel, then it should be RGB; otherwise assume it is BGR
+    return Image(pixels, w, h, 4, ch == 3 ? Image::RGB : Image::BGR);
+}
+#endif
+
+#ifdef USE_LIBJPEG_TURBO
+Image DecodeTurboJpeg(const uint8_t *data, size_t len)
+{
+    tjhandle tj = tjInitDecompress();
+    if (tj == nullptr) {
+        return Image();
+    }
+
+    Image im;
+
+    int w, h, subsamp, colorspace;
+    if (tjDecompressHeader3(tj, data, (unsigned long)len, &w, &h, &subsamp, &colorspace) == 0
+        && w <= maxImageDimension && h <= maxImageDimension) {
+        uint8_t *pixels = (uint8_t *)STBI_MALLOC((size_t)w * h * 4);
+        if (pixels && tjDecompress2(tj, data, (unsigned long)len, pixels, w, 0, h, TJPF_BGRA, 0) == 0) {
+            im = Image(pixels, w, h, 4, Image::BGR);
+        } else {
+            DBG << "libjpeg-turbo: " << tjGetErrorStr2(tj);
+            if (pixels) {
+                STBI_FREE(pixels);
+            }
+        }
+    }
+
+    tjDestroy(tj);
+    return im;
+}
+#endif
+
+#ifdef USE_LIBSPNG
+Image DecodeSpng(const uint8_t *data, size_t len)
+{
+    spng_ctx *ctx = spng_ctx_new(0);
+    if (ctx == nullptr) {
+        return Image();
+    }
+
+    Image im;
+    uint8_t *pixels = nullptr;
+
+    do {
+        if (spng_set_image_limits(ctx, maxImageDimension, maxImageDimension)) {
+            break;
+        }
+
+        if (spng_set_png_buffer(ctx, data, len)) {
+            break;
+        }
+
+        size_t size;
+        spng_ihdr ihdr;
+        if (spng_get_ihdr(ctx, &ihdr) || spng_decoded_image_size(ctx, SPNG_FMT_RGBA8, &size)) {
+            break;
+        }
+
+        pixels = (uint8_t *)STBI_MALLOC(size);
+        if (pixels == nullptr) {
+            break;
+        }
+
+        if (int err = spng_decode_image(ctx, pixels, size, SPNG_FMT_RGBA8, SPNG_DECODE_TRNS); err) {
+            DBG << "libspng: " << spng_strerror(err);
+            break;
+        }
+
+        im = Image(pixels, (int)ihdr.width, (int)ihdr.height, 4, Image::RGB);
+        pixels = nullptr;
+    } while (false);
+
+    if (pixels) {
+        STBI_FREE(pixels);
+    }
+
+    spng_ctx_free(ctx);
+    return im;
+}
+#endif
+
+#ifdef USE_LIBWEBP
+Image DecodeWebP(const uint8_t *data, size_t len)
+{
+    int w, h;
+    if (!WebPGetInfo(data, len, &w, &h) || w > maxImageDimension || h > maxImageDimension) {
+        return Image();
+    }
+
+    size_t size = (size_t)w * h * 4;
+    uint8_t *pixels = (uint8_t *)STBI_MALLOC(size);
+    if (pixels == nullptr) {
+        return Image();
+    }
+
+    if (!WebPDecodeBGRAInto(data, len, pixels, size, w * 4)) {
+        DBG << "libwebp: unable to decode image";
+        STBI_FREE(pixels);
+        return Image();
+    }
+
+    return Image(pixels, w, h, 4, Image::BGR);
+}
+#endif
+
+std::mutex &RegistryLock()
+{
+    static std::mutex lock;
+    return lock;
+}
+
+std::vector<DecoderEntry> &Registry()
+{
+    static std::vector<DecoderEntry> decoders = [] {
+        std::vector<DecoderEntry> builtin;
+
+#ifdef USE_LIBJPEG_TURBO
+        builtin.push_back({ ImageFormat::JPEG, "libjpeg-turbo", DecodeTurboJpeg, 100 });
+#endif
+#ifdef USE_LIBSPNG
+        builtin.push_back({ ImageFormat::PNG, "libspng", DecodeSpng, 100 });
+#endif
+#ifdef USE_LIBWEBP
+        builtin.push_back({ ImageFormat::WebP, "libwebp", DecodeWebP, 100 });
+#endif
+
+        return builtin;
+    }();
+
+    return decoders;
+}
+}
+
+const char *ImageFormatName(ImageFormat format)
+{
+    switch (format) {
+    case ImageFormat::JPEG: return "JPEG";
+    case ImageFormat::PNG:  return "PNG";
+    case ImageFormat::GIF:  return "GIF";
+    case ImageFormat::BMP:  return "BMP";
+    case ImageFormat::PSD:  return "PSD";
+    case ImageFormat::WebP: return "WebP";
+    default:                return "Unknown";
+    }
+}
+
+ImageFormat SniffImageFormat(const uint8_t *data, size_t len)
+{
+    auto match = [&](size_t offset, const char *magic, size_t n) {
+        return len >= offset + n && memcmp(data + offset, magic, n) == 0;
+    };
+
+    if (match(0, "\xFF\xD8\xFF", 3)) {
+        return ImageFormat::JPEG;
+    }
+
+    if (match(0, "\x89PNG\r\n\x1A\n", 8)) {
+        return ImageFormat::PNG;
+    }
+
+    if (match(0, "GIF87a", 6) || match(0, "GIF89a", 6)) {
+        return ImageFormat::GIF;
+    }
+
+    if (match(0, "RIFF", 4) && match(8, "WEBP", 4)) {
+        return ImageFormat::WebP;
+    }
+
+    if (match(0, "BM", 2)) {
+        return ImageFormat::BMP;
+    }
+
+    if (match(0, "8BPS", 4)) {
+        return ImageFormat::PSD;
+    }
+
+    // TGA has no magic number
+    return ImageFormat::Unknown;
+}
+
+int ReadJpegOrientation(const uint8_t *data, size_t len)
+{
+    if (SniffImageFormat(data, len) != ImageFormat::JPEG) {
+        return 1;
+    }
+
+    size_t pos = 2;
+    while (pos + 4 <= len) {
+        if (data[pos] != 0xFF) {
+            return 1;
+        }
+
+        uint8_t marker = data[pos + 1];
+        if (marker == 0xFF) {
+            // fill byte
+            pos++;
+            continue;
+        }
+
+        // the metadata is over once the image data starts
+        if (marker == 0xDA || marker == 0xD9) {
+            return 1;
+        }
+
+        size_t size = (size_t)data[pos + 2] << 8 | data[pos + 3];
+        if (size < 2 || pos + 2 + size > len) {
+            return 1;
+        }
+
+        const uint8_t *segment = data + pos + 4;
+        size -= 2;
+        pos += 2 + size + 2;
+
+        if (marker != 0xE1 || size < 14 || memcmp(segment, "Exif\0\0", 6) != 0) {
+            continue;
+        }
+
+        // TIFF header, all offsets are relative to it
+        const uint8_t *tiff = segment + 6;
+        size_t tiffSize = size - 6;
+
+        bool little = tiff[0] == 'I' && tiff[1] == 'I';
+        if (!little && !(tiff[0] == 'M' && tiff[1] == 'M')) {
+            return 1;
+        }
+
+        auto u16 = [&](size_t at) {
+            return little ? (uint32_t)(tiff[at] | tiff[at + 1] << 8) : (uint32_t)(tiff[at] << 8 | tiff[at + 1]);
+        };
+
+        auto u32 = [&](size_t at) {
+            return little ? u16(at) | u16(at + 2) << 16 : u16(at) << 16 | u16(at + 2);
+        };
+
+        size_t ifd = u32(4);
+        if (ifd + 2 > tiffSize) {
+            return 1;
+        }
+
+        size_t count = u16(ifd);
+        for (size_t i = 0; i < count && ifd + 2 + i * 12 + 12 <= tiffSize; i++) {
+            size_t entry = ifd + 2 + i * 12;
+
+            // orientation is a single SHORT stored inline
+            if (u16(entry) == 0x0112 && u16(entry + 2) == 3) {
+                int orientation = (int)u16(entry + 8);
+                return orientation >= 1 && orientation <= 8 ? orientation : 1;
+            }
+        }
+
+        return 1;
+    }
+
+    return 1;
+}
+
+void ImageDecoder::Register(ImageFormat format, const char *name, DecodeFunc decode, int priority)
+{
+    std::lock_guard _(RegistryLock());
+
+    auto &decoders = Registry();
+    decoders.push_back({ format, name, decode, priority });
+
+    std::stable_sort(decoders.begin(), decoders.end(), [](const auto &a, const auto &b) {
+        return a.priority > b.priority;
+    });
+}
+
+Image ImageDecoder::Decode(const uint8_t *data, size_t len)
+{
+    TIMEIT_START(Decode);
+
+    auto format = SniffImageFormat(data, len);
+
+    std::vector<DecoderEntry> candidates;
+    {
+        std::lock_guard _(RegistryLock());
+        for (const auto &decoder : Registry()) {
+            if (decoder.format == format) {
+                candidates.push_back(decoder);
+            }
+        }
+    }
+
+    TIMEIT(Decode, "Sniff format");
+
+    Image im;
+    for (const auto &decoder : candidates) {
+        im = decoder.decode(data, len);
+        TIMEIT(Decode, decoder.name);
+        if (im) {
+            break;
+        }
+
+        DBG << decoder.name << " failed to decode " << ImageFormatName(format) << " image, trying next decoder";
+    }
+
+#ifndef USE_OPENCV
+    if (!im && format != ImageFormat::WebP) {
+        im = DecodeStb(data, len);
+        TIMEIT(Decode, "stb_image");
+    }
+#endif
+
+    if (!im) {
+        DBG << "Unable to decode " << ImageFormatName(format) << " image";
+    } else {
+        DBG << "Decoded " << ImageFormatName(format) << " image " << im.width << "x" << im.height;
+    }
+
+    TIMEIT_END(Decode);
+    return im;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class Image;
+
+enum class ImageFormat
+{
+    Unknown,
+    JPEG,
+    PNG,
+    GIF,
+    BMP,
+    PSD,
+    WebP,
+};
+
+const char *ImageFormatName(ImageFormat format);
+
+// Detect the container format from the leading magic bytes
+ImageFormat SniffImageFormat(const uint8_t *data, size_t len);
+
+// EXIF orientation (1-8) of a JPEG file, 1 if there is none
+int ReadJpegOrientation(const uint8_t *data, size_t len);
+
+// Registry of image decoders. Image::open sniffs the format and tries the
+// decoders registered for it in order of priority, stb_image is always the
+// last resort for the formats it understands.
+//
+// Native codecs are compiled in with USE_LIBJPEG_TURBO, USE_LIBSPNG and
+// USE_LIBWEBP, the same way USE_OPENCV switches the OpenCV backend.
+class ImageDecoder
+{
+public:
+    // Every decoder returns 4 channel 8-bit pixels allocated with STBI_MALLOC,
+    // or an empty image if it cannot handle the input
+    using DecodeFunc = Image(*)(const uint8_t *data, size_t len);
+
+    // Higher priority decoders are tried first
+    static void Register(ImageFormat format, const char *name, DecodeFunc decode, int priority = 0);
+
+    static Image Decode(const uint8_t *data, size_t len);
+};
@@ -0,0 +1,167 @@
+#include "ImageOrient.h"
+#include "Image.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ORIENT_SSE2
+#endif
+
+namespace {
+// output pixels per side of a tile, 32x32 BGRA is 4KB on both sides
+constexpr int tileSize = 32;
+
+// out(x, y) = src(sx, sy), the axes are swapped first and then flipped
+struct Mapping
+{
+    bool swap;
+    bool flipX;
+    bool flipY;
+
+    Mapping(int orientation) :
+        swap(OrientationSwapsAxes(orientation)),
+        flipX(orientation == 2 || orientation == 3 || orientation == 7 || orientation == 8),
+        flipY(orientation == 3 || orientation == 4 || orientation == 6 || orientation == 7)
+    {}
+};
+
+void CopyPixels(const uint8_t *src, int w, int h, uint8_t *dst, int ch, const Mapping &m,
+                int x0, int x1, int y0, int y1)
+{
+    int dstWidth = m.swap ? h : w;
+
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            int sx = m.swap ? y : x;
+            int sy = m.swap ? x : y;
+            if (m.flipX) {
+                sx = w - 1 - sx;
+            }
+            if (m.flipY) {
+                sy = h - 1 - sy;
+            }
+
+            memcpy(dst + ((size_t)y * dstWidth + x) * ch, src + ((size_t)sy * w + sx) * ch, ch);
+        }
+    }
+}
+
+#ifdef ORIENT_SSE2
+inline __m128i Reverse(__m128i v)
+{
+    return _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+// 4 channel pixels, only the multiple of 4 part is done here
+void FlipRows(const uint8_t *src, int w, int h, uint8_t *dst, const Mapping &m)
+{
+    const int w4 = w & ~3;
+
+    for (int y = 0; y < h; y++) {
+        const uint32_t *s = (const uint32_t *)src + (size_t)(m.flipY ? h - 1 - y : y) * w;
+        uint32_t *d = (uint32_t *)dst + (size_t)y * w;
+
+        if (!m.flipX) {
+            memcpy(d, s, (size_t)w4 * 4);
+            continue;
+        }
+
+        for (int x = 0; x < w4; x += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(s + w - 4 - x));
+            _mm_storeu_si128((__m128i *)(d + x), Reverse(v));
+        }
+    }
+}
+
+void TransposeTiles(const uint8_t *src, int w, int h, uint8_t *dst, const Mapping &m)
+{
+    // output is h x w
+    const int w4 = h & ~3;
+    const int h4 = w & ~3;
+
+    const uint32_t *s = (const uint32_t *)src;
+    uint32_t *d = (uint32_t *)dst;
+
+    for (int ty = 0; ty < h4; ty += tileSize) {
+        for (int tx = 0; tx < w4; tx += tileSize) {
+            int yEnd = std::min(ty + tileSize, h4);
+            int xEnd = std::min(tx + tileSize, w4);
+
+            for (int y = ty; y < yEnd; y += 4) {
+                // output rows y..y+3 are the source columns starting at c0
+                int c0 = m.flipX ? w - 4 - y : y;
+
+                for (int x = tx; x < xEnd; x += 4) {
+                    __m128 r[4];
+                    for (int k = 0; k < 4; k++) {
+                        int sy = m.flipY ? h - 1 - (x + k) : x + k;
+                        __m128i v = _mm_loadu_si128((const __m128i *)(s + (size_t)sy * w + c0));
+                        r[k] = _mm_castsi128_ps(m.flipX ? Reverse(v) : v);
+                    }
+
+                    _MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+
+                    for (int j = 0; j < 4; j++) {
+                        _mm_storeu_si128((__m128i *)(d + (size_t)(y + j) * h + x), _mm_castps_si128(r[j]));
+                    }
+                }
+            }
+        }
+    }
+}
+#endif
+}
+
+bool OrientPixels(const uint8_t *src, int w, int h, uint8_t *dst, int ch, int orientation)
+{
+    if (!src || !dst || w <= 0 || h <= 0 || ch <= 0) {
+        return false;
+    }
+
+    if (orientation < 1 || orientation > 8) {
+        orientation = 1;
+    }
+
+    Mapping m(orientation);
+
+    const int dstWidth = m.swap ? h : w;
+    const int dstHeight = m.swap ? w : h;
+
+    if (orientation == 1) {
+        memcpy(dst, src, (size_t)w * h * ch);
+        return true;
+    }
+
+#ifdef ORIENT_SSE2
+    if (ch == 4) {
+        if (m.swap) {
+            TransposeTiles(src, w, h, dst, m);
+        } else {
+            FlipRows(src, w, h, dst, m);
+        }
+
+        // the edges which do not fill a whole 4x4 block
+        int w4 = dstWidth & ~3;
+        int h4 = m.swap ? dstHeight & ~3 : dstHeight;
+        CopyPixels(src, w, h, dst, ch, m, w4, dstWidth, 0, dstHeight);
+        CopyPixels(src, w, h, dst, ch, m, 0, w4, h4, dstHeight);
+        return true;
+    }
+#endif
+
+    CopyPixels(src, w, h, dst, ch, m, 0, dstWidth, 0, dstHeight);
+    return true;
+}
+
+Image OrientImage(const Image &src)
+{
+    bool swap = OrientationSwapsAxes(src.orientation);
+
+    Image dst = Image::create(swap ? src.height : src.width, swap ? src.width : src.height, src.ch, src.order);
+    if (!dst || !OrientPixels(src.data, src.width, src.height, dst.data, src.ch, src.orientation)) {
+        return Image();
+    }
+
+    return dst;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class Image;
+
+// EXIF orientation 5-8 are rotated by 90 degree, width and height are swapped
+inline bool OrientationSwapsAxes(int orientation)
+{
+    return orientation >= 5 && orientation <= 8;
+}
+
+// Apply an EXIF orientation (1-8) to w x h pixels, dst is the upright image
+// and has its width and height swapped for orientation 5-8. Rotations are
+// done in cache sized tiles of 4x4 SSE2 transposes for 4 channel pixels.
+bool OrientPixels(const uint8_t *src, int w, int h, uint8_t *dst, int ch, int orientation);
+
+// The upright copy of an image decoded with an EXIF orientation
+Image OrientImage(const Image &src);
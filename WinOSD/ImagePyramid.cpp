@@ -0,0 +1,232 @@
+#include "ImagePyramid.h"
+
+#include "logging.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PYRAMID_SSE2
+#endif
+
+namespace {
+void HalveRow(const uint8_t *row0, const uint8_t *row1, uint8_t *dst, int w, int ch)
+{
+    int x = 0;
+
+#ifdef PYRAMID_SSE2
+    if (ch == 4) {
+        // 8 source pixels into 4. The sums of all four pixels are taken in 16 bits
+        // and rounded once, pavgb of pavgb would round twice and differ from below.
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i two = _mm_set1_epi16(2);
+
+        for (; x + 4 <= w; x += 4) {
+            const uint8_t *s0 = row0 + x * 8;
+            const uint8_t *s1 = row1 + x * 8;
+
+            __m128i a0 = _mm_loadu_si128((const __m128i *)s0);
+            __m128i a1 = _mm_loadu_si128((const __m128i *)(s0 + 16));
+            __m128i b0 = _mm_loadu_si128((const __m128i *)s1);
+            __m128i b1 = _mm_loadu_si128((const __m128i *)(s1 + 16));
+
+            // vertical sums of the source pixel pairs 0-1, 2-3, 4-5 and 6-7
+            __m128i p01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+            __m128i p23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+            __m128i p45 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+            __m128i p67 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+            // plus the horizontal neighbour
+            __m128i lo = _mm_add_epi16(_mm_unpacklo_epi64(p01, p23), _mm_unpackhi_epi64(p01, p23));
+            __m128i hi = _mm_add_epi16(_mm_unpacklo_epi64(p45, p67), _mm_unpackhi_epi64(p45, p67));
+
+            lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+            hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+
+            _mm_storeu_si128((__m128i *)(dst + x * 4), _mm_packus_epi16(lo, hi));
+        }
+    }
+#endif
+
+    for (; x < w; x++) {
+        const uint8_t *s0 = row0 + x * 2 * ch;
+        const uint8_t *s1 = row1 + x * 2 * ch;
+        for (int i = 0; i < ch; i++) {
+            dst[x * ch + i] = (uint8_t)((s0[i] + s0[i + ch] + s1[i] + s1[i + ch] + 2) >> 2);
+        }
+    }
+}
+}
+
+Image HalveImage(const Image &src)
+{
+    int w = src.width / 2;
+    int h = src.height / 2;
+
+    Image dst = Image::create(w, h, src.ch, src.order);
+    if (!dst) {
+        return dst;
+    }
+
+    dst.orientation = src.orientation;
+
+    size_t stride = (size_t)src.width * src.ch;
+    for (int y = 0; y < h; y++) {
+        const uint8_t *row0 = src.data + y * 2 * stride;
+        HalveRow(row0, row0 + stride, dst.data + (size_t)y * w * src.ch, w, src.ch);
+    }
+
+    return dst;
+}
+
+ImagePyramid::ImagePyramid(Image &&decoded, int maxWidth, Image::ResizeMode mode) :
+    mode(mode)
+{
+    Image base = std::move(decoded);
+
+    if (base) {
+        // fit in the stored orientation, so the rotation below runs on the small image
+        bool swapAxes = OrientationSwapsAxes(base.orientation);
+        int w = swapAxes ? base.height : base.width;
+        int h = swapAxes ? base.width : base.height;
+
+        if (maxWidth > 0 && w > maxWidth) {
+            h = std::max((int)((float)h * maxWidth / w), 1);
+            w = maxWidth;
+
+            DBG << "Fit pyramid base " << base.width << "x" << base.height << " to width " << w;
+            base = swapAxes ? base.resize(h, w, mode) : base.resize(w, h, mode);
+        }
+
+        if (base && base.orientation != 1) {
+            base = OrientImage(base);
+        }
+    }
+
+    levels.push_back(std::make_shared<const Image>(std::move(base)));
+    used.push_back(true);
+}
+
+std::shared_ptr<const Image> ImagePyramid::Level(size_t i)
+{
+    if (i >= levels.size()) {
+        levels.resize(i + 1);
+        used.resize(i + 1);
+    }
+
+    used[i] = true;
+    if (levels[i]) {
+        return levels[i];
+    }
+
+    auto parent = Level(i - 1);
+
+    Image half;
+    if (mode == Image::LinearLight) {
+        // an exact 2x2 area average in linear light
+        half = parent->resize(parent->width / 2, parent->height / 2, mode);
+    } else {
+        half = HalveImage(*parent);
+    }
+
+    DBG << "Build pyramid level " << i << " (" << half.width << "x" << half.height << ")";
+
+    if (usage) {
+        *usage += half.size();
+    }
+
+    levels[i] = std::make_shared<const Image>(std::move(half));
+    return levels[i];
+}
+
+std::shared_ptr<const Image> ImagePyramid::Scaled(int w)
+{
+    std::shared_ptr<const Image> level;
+    int h;
+
+    {
+        std::lock_guard _(lock);
+
+        if (!*levels[0] || w >= width()) {
+            used[0] = true;
+            level = levels[0];
+            w = width();
+            h = height();
+        } else {
+            h = (int)((float)height() * w / width());
+            if (w <= 0 || h <= 0) {
+                return nullptr;
+            }
+
+            // the smallest level which is still at least as large as the output
+            size_t i = 0;
+            while ((levels[0]->width >> (i + 1)) >= w && (levels[0]->height >> (i + 1)) >= h) {
+                i++;
+            }
+
+            level = Level(i);
+        }
+    }
+
+    if (!*level || (level->width == w && level->height == h)) {
+        return level;
+    }
+
+    return std::make_shared<const Image>(level->resize(w, h, mode));
+}
+
+size_t ImagePyramid::size() const
+{
+    std::lock_guard _(lock);
+    return SizeLocked();
+}
+
+size_t ImagePyramid::SizeLocked() const
+{
+    size_t bytes = 0;
+    for (auto &level : levels) {
+        if (level) {
+            bytes += level->size();
+        }
+    }
+
+    return bytes;
+}
+
+size_t ImagePyramid::Trim()
+{
+    std::lock_guard _(lock);
+
+    size_t freed = 0;
+
+    // level 0 is needed to rebuild the others
+    for (size_t i = 1; i < levels.size(); i++) {
+        if (levels[i] && !used[i] && levels[i].use_count() == 1) {
+            freed += levels[i]->size();
+            levels[i].reset();
+        }
+
+        used[i] = false;
+    }
+
+    if (usage) {
+        *usage -= freed;
+    }
+
+    return freed;
+}
+
+void ImagePyramid::Attach(std::atomic<size_t> *counter)
+{
+    std::lock_guard _(lock);
+
+    size_t bytes = SizeLocked();
+    if (usage) {
+        *usage -= bytes;
+    }
+
+    usage = counter;
+    if (usage) {
+        *usage += bytes;
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Image.h"
+#include "ImageOrient.h"
+
+// Mip chain of a decoded image. Level 0 is the decoded image fitted to the
+// display width and turned upright by its EXIF orientation, both once when the
+// pyramid is built, so the full resolution image is never kept. Every further
+// level halves the previous one and is only built when a smaller size is
+// requested. Any width is served from the nearest level that is not smaller,
+// so a zoom only costs a cheap final resample.
+class ImagePyramid
+{
+public:
+    // `maxWidth` is the widest the image is ever shown, 0 keeps the full size
+    ImagePyramid(Image &&decoded, int maxWidth, Image::ResizeMode mode = Image::Naive);
+
+    int width() const
+    {
+        return levels[0]->width;
+    }
+
+    int height() const
+    {
+        return levels[0]->height;
+    }
+
+    explicit operator bool() const
+    {
+        return *levels[0];
+    }
+
+    // The image scaled down to `w`, keeping the aspect ratio. Images are
+    // never upscaled, a larger width returns level 0.
+    std::shared_ptr<const Image> Scaled(int w);
+
+    // bytes held by all built levels
+    size_t size() const;
+
+    // Drop the levels which were not used since the last trim and are not
+    // referenced by a toast. Returns the bytes freed.
+    size_t Trim();
+
+    // Add the built levels to `usage`, and every level built or dropped from
+    // now on, until attached to another counter or nullptr.
+    void Attach(std::atomic<size_t> *usage);
+
+private:
+    std::shared_ptr<const Image> Level(size_t i);
+    size_t SizeLocked() const;
+
+    Image::ResizeMode mode;
+
+    mutable std::mutex lock;
+
+    std::vector<std::shared_ptr<const Image>> levels;
+    std::vector<bool> used;
+
+    std::atomic<size_t> *usage = nullptr;
+};
+
+// 2x2 box filter, odd rows and columns at the end are dropped
+Image HalveImage(const Image &src);
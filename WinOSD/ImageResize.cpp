@@ -0,0 +1,265 @@
+#include "ImageResize.h"
+#include "Image.h"
+
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RESIZE_SSE2
+#endif
+
+namespace {
+// linear values are 15-bit, so they fit signed 16-bit SIMD lanes
+constexpr int linearBits = 15;
+constexpr int weightBits = 14;
+constexpr int tableBits = 12;
+
+constexpr int linearMax = (1 << linearBits) - 1;
+constexpr int weightOne = 1 << weightBits;
+constexpr int tableSize = 1 << tableBits;
+
+struct Tables
+{
+    int16_t toLinear[256];
+    int16_t alphaToLinear[256];
+    uint8_t toSrgb[tableSize];
+    uint8_t alphaToSrgb[tableSize];
+
+    Tables()
+    {
+        for (int i = 0; i < 256; i++) {
+            double c = i / 255.0;
+            double l = c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+            toLinear[i] = (int16_t)std::lround(l * linearMax);
+            alphaToLinear[i] = (int16_t)std::lround(c * linearMax);
+        }
+
+        for (int i = 0; i < tableSize; i++) {
+            double l = (double)i / (tableSize - 1);
+            double s = l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1 / 2.4) - 0.055;
+            toSrgb[i] = (uint8_t)std::lround(s * 255);
+            alphaToSrgb[i] = (uint8_t)std::lround(l * 255);
+        }
+    }
+};
+
+const Tables &GetTables()
+{
+    static const Tables tables;
+    return tables;
+}
+
+// Source pixels covered by one output pixel, the weights are the covered
+// areas in Q14 and always sum up to exactly 1.0
+struct Contribution
+{
+    int first;
+    int count;
+    size_t weights;
+};
+
+void ComputeContributions(int srcSize, int dstSize,
+                          std::vector<Contribution> &contribs, std::vector<int16_t> &weights)
+{
+    double scale = (double)srcSize / dstSize;
+
+    contribs.resize(dstSize);
+    weights.clear();
+
+    for (int d = 0; d < dstSize; d++) {
+        double start = d * scale;
+        double end = std::min((d + 1) * scale, (double)srcSize);
+
+        int first = (int)start;
+        int last = std::min((int)std::ceil(end), srcSize);
+
+        contribs[d] = Contribution{ first, last - first, weights.size() };
+
+        // accumulate in double and round the running sum, so the rounding errors never add up
+        double covered = 0.0;
+        int assigned = 0;
+        for (int s = first; s < last; s++) {
+            covered += std::min(s + 1.0, end) - std::max((double)s, start);
+            int total = (int)std::lround(covered / (end - start) * weightOne);
+            weights.push_back((int16_t)(total - assigned));
+            assigned = total;
+        }
+    }
+}
+
+// acc[i] += row[i] * weight
+void Accumulate(int32_t *acc, const int16_t *row, int16_t weight, size_t n)
+{
+    size_t i = 0;
+
+#ifdef RESIZE_SSE2
+    const __m128i w = _mm_set1_epi16(weight);
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(row + i));
+
+        // 16x16 -> 32-bit products, both operands are non-negative 15-bit values
+        __m128i lo = _mm_mullo_epi16(v, w);
+        __m128i hi = _mm_mulhi_epi16(v, w);
+
+        __m128i *a = (__m128i *)(acc + i);
+        _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), _mm_unpacklo_epi16(lo, hi)));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(lo, hi)));
+    }
+#endif
+
+    for (; i < n; i++) {
+        acc[i] += row[i] * weight;
+    }
+}
+
+// One source row in linear light. Color is premultiplied by alpha so transparent
+// pixels, whatever color they have, do not bleed into their neighbours. Pixels
+// take `lanes` values, 3 channels are padded to 4 for the SIMD pass.
+void LinearizeRow(const uint8_t *src, int16_t *dst, int width, int ch, int lanes, int alpha, const Tables &tables)
+{
+    for (int x = 0; x < width; x++, src += ch, dst += lanes) {
+        if (alpha < 0) {
+            for (int i = 0; i < ch; i++) {
+                dst[i] = tables.toLinear[src[i]];
+            }
+            continue;
+        }
+
+        int a = src[alpha];
+        for (int i = 0; i < ch; i++) {
+            dst[i] = i == alpha ? tables.alphaToLinear[a] : (int16_t)((tables.toLinear[src[i]] * a + 127) / 255);
+        }
+    }
+}
+
+void HorizontalPass(const int16_t *src, int16_t *dst, int ch, int lanes,
+                    const std::vector<Contribution> &contribs, const std::vector<int16_t> &weights)
+{
+    for (size_t x = 0; x < contribs.size(); x++) {
+        const auto &c = contribs[x];
+        const int16_t *w = &weights[c.weights];
+        const int16_t *p = src + (size_t)c.first * lanes;
+
+        int32_t acc[4] = { 0, 0, 0, 0 };
+
+#ifdef RESIZE_SSE2
+        if (lanes == 4) {
+            // two pixels per step, the channels interleaved so pmaddwd sums both products
+            __m128i sum = _mm_setzero_si128();
+
+            int k = 0;
+            for (; k + 2 <= c.count; k += 2) {
+                __m128i v = _mm_loadu_si128((const __m128i *)(p + k * 4));
+                __m128i pair = _mm_unpacklo_epi16(v, _mm_srli_si128(v, 8));
+                __m128i wk = _mm_set1_epi32((uint16_t)w[k] | (int32_t)w[k + 1] << 16);
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(pair, wk));
+            }
+
+            if (k < c.count) {
+                __m128i v = _mm_loadl_epi64((const __m128i *)(p + k * 4));
+                __m128i pair = _mm_unpacklo_epi16(v, _mm_setzero_si128());
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(pair, _mm_set1_epi32((uint16_t)w[k])));
+            }
+
+            _mm_storeu_si128((__m128i *)acc, sum);
+        } else
+#endif
+        {
+            for (int k = 0; k < c.count; k++, p += lanes) {
+                for (int i = 0; i < ch; i++) {
+                    acc[i] += p[i] * w[k];
+                }
+            }
+        }
+
+        for (int i = 0; i < ch; i++) {
+            dst[x * ch + i] = (int16_t)((acc[i] + (weightOne >> 1)) >> weightBits);
+        }
+    }
+}
+}
+
+bool ResizeLinearLight(const uint8_t *src, int srcWidth, int srcHeight, size_t srcStride,
+                       uint8_t *dst, int dstWidth, int dstHeight, size_t dstStride,
+                       int ch)
+{
+    if (!src || !dst || srcWidth <= 0 || srcHeight <= 0 || dstWidth <= 0 || dstHeight <= 0 || ch < 1 || ch > 4) {
+        return false;
+    }
+
+    if (dstWidth > srcWidth || dstHeight > srcHeight) {
+#ifdef USE_OPENCV
+        return false;
+#else
+        // an area average is only meaningful for downscaling
+        return stbir_resize_uint8_srgb(src, srcWidth, srcHeight, (int)srcStride,
+                                       dst, dstWidth, dstHeight, (int)dstStride, ch,
+                                       ch == 4 || ch == 2 ? ch - 1 : STBIR_ALPHA_CHANNEL_NONE, 0) != 0;
+#endif
+    }
+
+    const auto &tables = GetTables();
+    const int alpha = ch == 4 || ch == 2 ? ch - 1 : -1;
+
+    std::vector<Contribution> hContribs, vContribs;
+    std::vector<int16_t> hWeights, vWeights;
+    ComputeContributions(srcWidth, dstWidth, hContribs, hWeights);
+    ComputeContributions(srcHeight, dstHeight, vContribs, vWeights);
+
+    const size_t rowSize = (size_t)dstWidth * ch;
+    const int lanes = ch == 3 ? 4 : ch;
+
+    // Source rows are resized horizontally once and streamed into the output
+    // rows they cover, a row on the boundary of two output rows is reused
+    std::vector<int16_t> linear((size_t)srcWidth * lanes);
+    std::vector<int16_t> row(rowSize);
+    std::vector<int32_t> acc(rowSize);
+    int cachedRow = -1;
+
+    const int shift = linearBits + weightBits - tableBits;
+    const int32_t round = 1 << (shift - 1);
+
+    for (int y = 0; y < dstHeight; y++) {
+        const auto &c = vContribs[y];
+        const int16_t *w = &vWeights[c.weights];
+
+        std::fill(acc.begin(), acc.end(), 0);
+
+        for (int k = 0; k < c.count; k++) {
+            int sy = c.first + k;
+            if (sy != cachedRow) {
+                LinearizeRow(src + sy * srcStride, linear.data(), srcWidth, ch, lanes, alpha, tables);
+                HorizontalPass(linear.data(), row.data(), ch, lanes, hContribs, hWeights);
+                cachedRow = sy;
+            }
+
+            Accumulate(acc.data(), row.data(), w[k], rowSize);
+        }
+
+        uint8_t *out = dst + y * dstStride;
+        if (alpha < 0) {
+            for (size_t i = 0; i < rowSize; i++) {
+                out[i] = tables.toSrgb[std::min((acc[i] + round) >> shift, tableSize - 1)];
+            }
+            continue;
+        }
+
+        for (size_t p = 0; p < rowSize; p += ch) {
+            int32_t a = acc[p + alpha];
+            for (int i = 0; i < ch; i++) {
+                if (i == alpha) {
+                    out[p + i] = tables.alphaToSrgb[std::min((a + round) >> shift, tableSize - 1)];
+                } else if (a <= 0) {
+                    out[p + i] = 0;
+                } else {
+                    // undo the premultiplication, color / alpha is the linear value
+                    int64_t idx = ((int64_t)acc[p + i] * (tableSize - 1) + a / 2) / a;
+                    out[p + i] = tables.toSrgb[std::min(idx, (int64_t)tableSize - 1)];
+                }
+            }
+        }
+    }
+
+    return true;
+}
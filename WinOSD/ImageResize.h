@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Downscale 8-bit sRGB pixels in linear light. Naive averaging of sRGB values
+// darkens fine detail (e.g. text in screenshots), this converts through
+// 256 entry sRGB -> linear and 4096 entry linear -> sRGB tables and does an
+// area average in between. The 4th channel is alpha and stays linear, color is
+// weighted by it so fully transparent pixels do not tint the edges.
+//
+// Upscaling is forwarded to stb_image_resize in sRGB mode.
+bool ResizeLinearLight(const uint8_t *src, int srcWidth, int srcHeight, size_t srcStride,
+                       uint8_t *dst, int dstWidth, int dstHeight, size_t dstStride,
+                       int ch);
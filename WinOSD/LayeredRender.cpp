@@ -19,6 +19,42 @@
 
 using Microsoft::WRL::ComPtr;
 
+namespace {
+// more rectangles than this are merged into their bounds, each one is a
+// separate clip and clear
+constexpr size_t maxDirtyRects = 8;
+
+// the swap chain grows and shrinks in steps of this many rows
+constexpr UINT32 surfaceStep = 256;
+
+RECT ToRect(float x, float y, UINT32 width, UINT32 height)
+{
+    return RECT{ (LONG)x, (LONG)y, (LONG)x + (LONG)width, (LONG)y + (LONG)height };
+}
+
+// clips to `bounds` and drops empty rectangles, or merges them if there are too many
+void ClipRects(std::vector<RECT> &rects, const RECT &bounds)
+{
+    std::vector<RECT> clipped;
+    for (const auto &r : rects) {
+        RECT c;
+        if (IntersectRect(&c, &r, &bounds)) {
+            clipped.push_back(c);
+        }
+    }
+
+    if (clipped.size() > maxDirtyRects) {
+        RECT merged = clipped[0];
+        for (const auto &r : clipped) {
+            UnionRect(&merged, &merged, &r);
+        }
+        clipped = { merged };
+    }
+
+    rects = std::move(clipped);
+}
+}
+
 inline std::wstring NowString()
 {
     std::time_t t = std::time(nullptr);
@@ -27,14 +63,20 @@ inline std::wstring NowString()
     return buf;
 }
 
-int LayeredRender::AddToast(const std::wstring &title, const std::wstring &text, const Image &im, const std::wstring &link)
+int LayeredRender::AddToast(const InternedString &title, const InternedString &text, const Image &im, const InternedString &link,
+                            std::shared_ptr<Animation> animation)
 {
     TIMEIT_START(AddToast);
 
+    // toasts of concurrent requests are drawn in parallel, each with its own contexts
+    auto raster = AcquireRasterContext();
+    auto &rasterContext = raster->content;
+    auto &glowContext = raster->glow;
+
     float boxHeight = marginTop;
     float titleHeight = 0.f;
     float textHeight = 0.f, lineHeight = 0.f;
-    float imageHeight = 0.f;
+    float imageHeight = 0.f, imageLeft = 0.f;
 
     // TODO: better typesetting for timestamp
     ComPtr<IDWriteTextLayout> timeLayout;
@@ -52,53 +94,50 @@ int LayeredRender::AddToast(const std::wstring &title, const std::wstring &text,
         TIMEIT(AddToast, "Init Time string");
     }
 
+    // cached layouts are not limited in height, text running past the bottom
+    // of the box is clipped when it is drawn. 0 if it fits.
+    float titleClip = 0.f, textClip = 0.f;
+
     ComPtr<IDWriteTextLayout> titleLayout;
     if (!title.empty()) {
-        ThrowIfFailed(
-            dwFactory->CreateTextLayout(
-                title.c_str(), (UINT32)title.size(),
-                dwTitleFormat.Get(),
-                boxMaxWidth - marginLeft * 2,
-                boxMaxHeight - boxHeight - marginBottom,
-                &titleLayout
-            )
+        auto cached = layoutCache.Get(
+            dwFactory.Get(), title,
+            dwTitleFormat.Get(),
+            boxMaxWidth - marginLeft * 2
         );
+        titleLayout = cached.layout;
 
-        DWRITE_TEXT_METRICS metrics;
-        ThrowIfFailed(
-            titleLayout->GetMetrics(&metrics)
-        );
+        float height = cached.metrics.height;
+        float available = boxMaxHeight - boxHeight - marginBottom;
+        if (height > available) {
+            height = std::max(available, 0.f);
+            titleClip = boxHeight + height;
+        }
 
         titleHeight = boxHeight;
-        boxHeight += metrics.height * 1.25f;
+        boxHeight += height * 1.25f;
         TIMEIT(AddToast, "Init Title");
     }
 
     ComPtr<IDWriteTextLayout> textLayout;
     if (!text.empty()) {
-        ThrowIfFailed(
-            dwFactory->CreateTextLayout(
-                text.c_str(), (UINT32)text.size(),
-                dwTextFormat.Get(),
-                boxMaxWidth - marginLeft * 2,
-                boxMaxHeight - boxHeight - marginBottom,
-                &textLayout
-            )
+        auto cached = layoutCache.Get(
+            dwFactory.Get(), text,
+            dwTextFormat.Get(),
+            boxMaxWidth - marginLeft * 2
         );
+        textLayout = cached.layout;
 
-        DWRITE_TEXT_METRICS metrics;
-        ThrowIfFailed(
-            textLayout->GetMetrics(&metrics)
-        );
+        float height = cached.metrics.height;
+        float available = boxMaxHeight - boxHeight - marginBottom;
+        if (height > available) {
+            height = std::max(available, 0.f);
+            textClip = boxHeight + height;
+        }
 
         textHeight = boxHeight;
-        boxHeight += metrics.height;
-
-        UINT32 lineCount = metrics.lineCount;
-        std::vector<DWRITE_LINE_METRICS> lineMetrics;
-        lineMetrics.resize(lineCount);
-        ThrowIfFailed(textLayout->GetLineMetrics(lineMetrics.data(), lineCount, &lineCount));
-        lineHeight = lineMetrics.back().height;
+        boxHeight += height;
+        lineHeight = cached.lastLineHeight;
         TIMEIT(AddToast, "Init Text");
     }
 
@@ -109,7 +148,7 @@ int LayeredRender::AddToast(const std::wstring &title, const std::wstring &text,
         assert(im.height <= boxMaxHeight - boxHeight - marginBottom);
 
         ThrowIfFailed(
-            d2dRTContext->CreateBitmap(
+            rasterContext->CreateBitmap(
                 { (UINT32)im.width, (UINT32)im.height },
                 im.data, im.ch * im.width,
                 {
@@ -123,9 +162,11 @@ int LayeredRender::AddToast(const std::wstring &title, const std::wstring &text,
             )
         );
         // assume normal image dose not have pre alpha multiply
-        d2dEffectPremultiply->SetInput(0, imageBitmap.Get());
+        raster->premultiply->SetInput(0, imageBitmap.Get());
 
-        imageHeight = lineHeight + boxHeight;
+        // keep the image pixel aligned, animation frames are copied into that region
+        imageLeft = std::floor((boxMaxWidth - im.width) / 2); // center of the box
+        imageHeight = std::floor(lineHeight + boxHeight);
         boxHeight += lineHeight + im.height;
 
         TIMEIT(AddToast, "Init Image");
@@ -150,26 +191,48 @@ int LayeredRender::AddToast(const std::wstring &title, const std::wstring &text,
     // |        | <-------------box width------------> |
     //
 
-    auto d2dDraw = [&](IDWriteTextRenderer *textRenderer, ID2D1Bitmap *bmp) {
-        d2dRTContext->BeginDraw();
+    ComPtr<ID2D1Bitmap1> contentBmp, glowBmp;
+    {
+        ThrowIfFailed(
+            rasterContext->CreateBitmap(
+                D2D1_SIZE_U{ (UINT32)boxMaxWidth, (UINT32)boxHeight },
+                nullptr, 0,
+                D2D1_BITMAP_PROPERTIES1{
+                    pixelFormat, 0.f, 0.f,
+                    D2D1_BITMAP_OPTIONS_TARGET
+                },
+                &contentBmp)
+        );
 
-        TIMEITF(AddToast, "D2D Background", ([&] {
-            d2dRTContext->SetTransform(D2D1::IdentityMatrix());
-            d2dRTContext->Clear(D2D1::ColorF(D2D1::ColorF::Black, 0.f));
-            d2dRTContext->FillRoundedRectangle(
-                {
-                    D2D1_RECT_F {
-                        0, 0,
-                        boxMaxWidth, boxHeight
-                    },
-                    7.f, 7.f
+        ThrowIfFailed(
+            glowContext->CreateBitmap(
+                D2D1_SIZE_U{ (UINT32)boxMaxWidth, (UINT32)boxHeight },
+                nullptr, 0,
+                D2D1_BITMAP_PROPERTIES1{
+                    { DXGI_FORMAT_A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED },
+                    0.f, 0.f,
+                    D2D1_BITMAP_OPTIONS_TARGET
                 },
-                d2dBoxBrush.Get()
-            );
-                                             }));
+                &glowBmp)
+        );
+    }
+
+    // the text renderer fills into contentBmp and puts the glow into glowBmp
+    auto d2dDraw = [&](IDWriteTextRenderer *textRenderer) {
+        rasterContext->SetTarget(contentBmp.Get());
+        rasterContext->BeginDraw();
+        glowContext->SetTarget(glowBmp.Get());
+        glowContext->BeginDraw();
+
+        TIMEITF(AddToast, "D2D Clear", ([&] {
+            rasterContext->SetTransform(D2D1::IdentityMatrix());
+            rasterContext->Clear(D2D1::ColorF(D2D1::ColorF::Black, 0.f));
+            glowContext->SetTransform(D2D1::IdentityMatrix());
+            glowContext->Clear(D2D1::ColorF(D2D1::ColorF::Black, 0.f));
+                                        }));
 
         if (timeLayout) {
-            d2dRTContext->DrawTextLayout(
+            rasterContext->DrawTextLayout(
                 D2D1_POINT_2F{
                     0.f, 3.5f,
                 },
@@ -179,29 +242,41 @@ int LayeredRender::AddToast(const std::wstring &title, const std::wstring &text,
             TIMEIT(AddToast, "D2D Draw Timestamp");
         }
 
-        if (titleLayout) {
-            titleLayout->Draw(
-                d2dRTContext.Get(),
+        // the renderer draws the glow too, both targets get the clip
+        auto drawLayout = [&](IDWriteTextLayout *layout, float top, float clip) {
+            if (clip > 0.f) {
+                D2D1_RECT_F rect = { 0.f, 0.f, boxMaxWidth, clip };
+                rasterContext->PushAxisAlignedClip(rect, D2D1_ANTIALIAS_MODE_ALIASED);
+                glowContext->PushAxisAlignedClip(rect, D2D1_ANTIALIAS_MODE_ALIASED);
+            }
+
+            layout->Draw(
+                rasterContext.Get(),
                 textRenderer,
-                marginLeft, titleHeight
+                marginLeft, top
             );
+
+            if (clip > 0.f) {
+                glowContext->PopAxisAlignedClip();
+                rasterContext->PopAxisAlignedClip();
+            }
+        };
+
+        if (titleLayout) {
+            drawLayout(titleLayout.Get(), titleHeight, titleClip);
             TIMEIT(AddToast, "D2D Draw Title");
         }
 
         if (textLayout) {
-            textLayout->Draw(
-                d2dRTContext.Get(),
-                textRenderer,
-                marginLeft, textHeight
-            );
+            drawLayout(textLayout.Get(), textHeight, textClip);
             TIMEIT(AddToast, "D2D Draw Text");
         }
 
         if (imageBitmap) {
-            d2dRTContext->DrawImage(
-                d2dEffectPremultiply.Get(),
+            rasterContext->DrawImage(
+                raster->premultiply.Get(),
                 D2D1_POINT_2F{
-                    (boxMaxWidth - im.width) / 2, // center of the box
+                    imageLeft,
                     imageHeight
                 },
             {
@@ -212,51 +287,44 @@ int LayeredRender::AddToast(const std::wstring &title, const std::wstring &text,
             TIMEIT(AddToast, "D2D Draw Image");
         }
 
-        ThrowIfFailed(d2dRTContext->EndDraw());
-        TIMEIT(AddToast, "D2D EndDraw");
+        ThrowIfFailed(rasterContext->EndDraw());
+        ThrowIfFailed(glowContext->EndDraw());
 
-        auto dest = D2D1_POINT_2U{ 0, 0 };
-        auto src = D2D1_RECT_U{ 0, 0, (UINT32)boxMaxWidth, (UINT32)boxHeight };
-
-        ThrowIfFailed(
-            bmp->CopyFromRenderTarget(
-                &dest, d2dRTContext.Get(), &src
-            )
-        );
+        // the toast may be presented while the next one is drawn
+        rasterContext->SetTarget(nullptr);
+        glowContext->SetTarget(nullptr);
+        TIMEIT(AddToast, "D2D EndDraw");
     };
 
-    ComPtr<ID2D1Bitmap> normalBmp, highlightBmp;
-    {
-        ThrowIfFailed(
-            d2dContext->CreateBitmap(
-                D2D1_SIZE_U{ (UINT32)boxMaxWidth, (UINT32)boxHeight },
-                D2D1_BITMAP_PROPERTIES{ pixelFormat, 0.f, 0.f },
-                &normalBmp)
-        );
+    d2dDraw(raster->textRenderer.Get());
 
-        ThrowIfFailed(
-            d2dContext->CreateBitmap(
-                D2D1_SIZE_U{ (UINT32)boxMaxWidth, (UINT32)boxHeight },
-                D2D1_BITMAP_PROPERTIES{ pixelFormat, 0.f, 0.f },
-                &highlightBmp)
-        );
-    }
-
-    d2dDraw(dwTextRenderer.Get(), normalBmp.Get());
-    d2dDraw(dwHighlightedRenderer.Get(), highlightBmp.Get());
+    // the image is not needed anymore, do not keep it alive in the pool
+    raster->premultiply->SetInput(0, nullptr);
+    ReleaseRasterContext(std::move(raster));
 
     int toastId = -1;
 
+    D2D1_RECT_U imageRect = {};
+    if (animation && imageBitmap) {
+        imageRect = D2D1_RECT_U{
+            (UINT32)imageLeft, (UINT32)imageHeight,
+            (UINT32)imageLeft + animation->width(), (UINT32)imageHeight + animation->height()
+        };
+    } else {
+        animation = nullptr;
+    }
+
     TIMEITF(AddToast, "Add to list", ([&] {
-        std::lock_guard _(renderLock);
         toastId = ++_counter;
-        toastList.emplace_front(
+        auto toast = std::make_shared<Toast>(
             Toast{
                 (UINT32)boxMaxWidth, (UINT32)boxHeight,
                 timer.ms(),
-                normalBmp, highlightBmp, toastId, link
+                contentBmp, glowBmp, toastId, link,
+                animation, imageRect, 0.0
             });
-        invalidated = true;
+
+        Post({ Command::Add, std::move(toast) });
     }));
 
     DBG << "Toast added";
@@ -308,7 +376,13 @@ void LayeredRender::CreateDeviceIndependentResources()
 
     // Create Direct2D factory.
     ThrowIfFailed(
-        D2D1CreateFactory<ID2D1Factory1>(D2D1_FACTORY_TYPE_SINGLE_THREADED, &d2dFactory)
+        D2D1CreateFactory<ID2D1Factory1>(D2D1_FACTORY_TYPE_MULTI_THREADED, &d2dFactory)
+    );
+
+    // toasts are drawn on the HTTP workers while the UI thread presents, the
+    // factory lock also guards the DXGI calls Direct2D does not make itself
+    ThrowIfFailed(
+        d2dFactory.As(&d2dMultithread)
     );
 
     // Create a shared DirectWrite factory.
@@ -343,11 +417,12 @@ void LayeredRender::CreateDeviceIndependentResources()
 
 void LayeredRender::CreateDeviceResources()
 {
-    RECT rect = {};
-    GetClientRect(Win32Application::GetHwnd(), &rect);
-
     const UINT creationFlags = D3D11_CREATE_DEVICE_BGRA_SUPPORT;
 
+    // the buffers of a new device hold nothing the damage tracking could reuse
+    fullRedraw = true;
+    lastDamage.clear();
+
     D3D_FEATURE_LEVEL featureLevels[] =
     {
         D3D_FEATURE_LEVEL_11_1,
@@ -414,7 +489,10 @@ void LayeredRender::CreateDeviceResources()
 
     // Create DirectComposition Resources
     {
-        // Create Swap Chain for Composition
+        // Create Swap Chain for Composition, it only covers the toast column and
+        // OnRender resizes it to the stack
+        surfaceOrigin = POINT{ (LONG)std::floor(posX), (LONG)std::floor(posY) };
+
         DXGI_SWAP_CHAIN_DESC1 description = {};
         description.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
         description.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
@@ -422,8 +500,8 @@ void LayeredRender::CreateDeviceResources()
         description.BufferCount = 2;
         description.SampleDesc.Count = 1;
         description.AlphaMode = DXGI_ALPHA_MODE_PREMULTIPLIED;
-        description.Width = rect.right - rect.left;
-        description.Height = rect.bottom - rect.top;
+        description.Width = (UINT32)std::ceil(boxMaxWidth);
+        description.Height = surfaceStep;
 
         ThrowIfFailed(
             dxFactory->CreateSwapChainForComposition(
@@ -448,6 +526,15 @@ void LayeredRender::CreateDeviceResources()
             dcompDevice->CreateVisual(&dcompVisual)
         );
 
+        // place the column in the window
+        ThrowIfFailed(
+            dcompVisual->SetOffsetX((float)surfaceOrigin.x)
+        );
+
+        ThrowIfFailed(
+            dcompVisual->SetOffsetY((float)surfaceOrigin.y)
+        );
+
         // Commit the visual to composition engine
         ThrowIfFailed(
             dcompVisual->SetContent(dxSwapChain.Get())
@@ -475,93 +562,154 @@ void LayeredRender::CreateDeviceResources()
             )
         );
 
-        // Retrieve the swap chain's back buffer
-        ComPtr<IDXGISurface2> surface;
-        ThrowIfFailed(
-            dxSwapChain->GetBuffer(0, __uuidof(IDXGISurface2), &surface)
-        );
-
-        // Create a Direct2D bitmap that points to the swap chain surface
-        ThrowIfFailed(
-            d2dContext->CreateBitmapFromDxgiSurface(
-                surface.Get(),
-                D2D1_BITMAP_PROPERTIES1{
-                    pixelFormat, 0.f, 0.f,
-                    D2D1_BITMAP_OPTIONS_TARGET | D2D1_BITMAP_OPTIONS_CANNOT_DRAW
-                },
-                &d2dTargetBitmap)
-        );
-
-        ThrowIfFailed(
-            d2dContext->CreateBitmap(
-                D2D1_SIZE_U{
-                    (UINT32)rect.right - rect.left,
-                    (UINT32)rect.bottom - rect.top
-                },
-                D2D1_BITMAP_PROPERTIES{ pixelFormat, 0.f, 0.f },
-                &d2dEmptyBitmap)
-        );
-
-        auto dest = D2D1_POINT_2U{ (UINT32)0, (UINT32)0 };
-        auto size = d2dEmptyBitmap->GetPixelSize();
-        auto src = D2D1_RECT_U{ 0, 0, size.width, size.height };
-
-        ThrowIfFailed(
-            d2dEmptyBitmap->CopyFromBitmap(
-                &dest, d2dTargetBitmap.Get(), &src
-            )
-        );
+        CreateTargetBitmap();
     }
 
-    // Create internal back buffer
+    // Create the resources shared by all contexts of the device, the contexts
+    // toasts are rasterized with are created on demand
     {
         ThrowIfFailed(
-            d2dContext->CreateCompatibleRenderTarget(
-                D2D1_SIZE_F{ boxMaxWidth, (float)rect.bottom - rect.top },
-                D2D1_SIZE_U{ (UINT32)boxMaxWidth, (UINT32)rect.bottom - rect.top },
-                pixelFormat, D2D1_COMPATIBLE_RENDER_TARGET_OPTIONS_NONE,
-                &d2dCacheTarget
-            )
-        );
-
-        ThrowIfFailed(
-            d2dCacheTarget.As(&d2dRTContext)
-        );
-
-        ThrowIfFailed(
-            d2dRTContext->CreateSolidColorBrush(
+            d2dContext->CreateSolidColorBrush(
                 D2D1::ColorF(D2D1::ColorF::White), &d2dWhiteBrush
             )
         );
 
         ThrowIfFailed(
-            d2dRTContext->CreateSolidColorBrush(
+            d2dContext->CreateSolidColorBrush(
                 D2D1::ColorF(D2D1::ColorF::White, 0.85f), &d2dTimeBrush
             )
         );
 
         ThrowIfFailed(
-            d2dRTContext->CreateSolidColorBrush(
+            d2dContext->CreateSolidColorBrush(
                 D2D1::ColorF(D2D1::ColorF::Black, 0.75f), &d2dBoxBrush
             )
         );
 
+        // the glow masks already have the opacity, the brushes only tint them
+        // and hovering must not change how strong the glow is
+        assert(glowColor.a == highlightColor.a);
+
         ThrowIfFailed(
-            d2dRTContext->CreateEffect(CLSID_D2D1Premultiply, &d2dEffectPremultiply)
+            d2dContext->CreateSolidColorBrush(
+                D2D1::ColorF(glowColor.r, glowColor.g, glowColor.b), &d2dGlowBrush
+            )
         );
 
-        dwTextRenderer = new (std::nothrow) GlowTextRenderer(
-            d2dFactory.Get(), d2dRTContext.Get(),
-            glowColor, glowWidth, glowStep
+        ThrowIfFailed(
+            d2dContext->CreateSolidColorBrush(
+                D2D1::ColorF(highlightColor.r, highlightColor.g, highlightColor.b), &d2dHighlightBrush
+            )
         );
 
-        dwHighlightedRenderer = new (std::nothrow) GlowTextRenderer(
-            d2dFactory.Get(), d2dRTContext.Get(),
-            highlightColor, glowWidth, glowStep
+        glyphAtlas = std::make_shared<GlyphAtlas>(
+            d2dDevice, std::make_shared<GlyphOutlineCache>(d2dFactory.Get()),
+            glowWidth, glowStep, glowColor.a,
+            distanceFieldText ? GlyphAtlas::Mode::DistanceField : GlyphAtlas::Mode::Strokes
         );
     }
 }
 
+std::unique_ptr<LayeredRender::RasterContext> LayeredRender::AcquireRasterContext()
+{
+    {
+        std::lock_guard _(rasterLock);
+        if (!rasterContexts.empty()) {
+            auto raster = std::move(rasterContexts.back());
+            rasterContexts.pop_back();
+            return raster;
+        }
+    }
+
+    // every context is busy with another toast, the pool grows up to the
+    // number of HTTP workers
+    DBG << "Creating raster context";
+
+    auto raster = std::make_unique<RasterContext>();
+
+    ComPtr<ID2D1DeviceContext> context;
+    ThrowIfFailed(
+        d2dDevice->CreateDeviceContext(
+            D2D1_DEVICE_CONTEXT_OPTIONS_NONE,
+            &context
+        )
+    );
+
+    ThrowIfFailed(
+        context.As(&raster->content)
+    );
+
+    ThrowIfFailed(
+        d2dDevice->CreateDeviceContext(
+            D2D1_DEVICE_CONTEXT_OPTIONS_NONE,
+            &raster->glow
+        )
+    );
+
+    // effects belong to the context that created them
+    ThrowIfFailed(
+        raster->content->CreateEffect(CLSID_D2D1Premultiply, &raster->premultiply)
+    );
+
+    raster->textRenderer = new (std::nothrow) GlowTextRenderer(
+        d2dFactory.Get(), raster->content, raster->glow,
+        glowWidth, glowStep, glowColor.a, useGlyphAtlas ? glyphAtlas : nullptr
+    );
+
+    return raster;
+}
+
+void LayeredRender::ReleaseRasterContext(std::unique_ptr<RasterContext> raster)
+{
+    std::lock_guard _(rasterLock);
+    rasterContexts.push_back(std::move(raster));
+}
+
+void LayeredRender::CreateTargetBitmap()
+{
+    // Retrieve the swap chain's back buffer
+    ComPtr<IDXGISurface2> surface;
+    ThrowIfFailed(
+        dxSwapChain->GetBuffer(0, __uuidof(IDXGISurface2), &surface)
+    );
+
+    // Create a Direct2D bitmap that points to the swap chain surface
+    ThrowIfFailed(
+        d2dContext->CreateBitmapFromDxgiSurface(
+            surface.Get(),
+            D2D1_BITMAP_PROPERTIES1{
+                pixelFormat, 0.f, 0.f,
+                D2D1_BITMAP_OPTIONS_TARGET | D2D1_BITMAP_OPTIONS_CANNOT_DRAW
+            },
+            &d2dTargetBitmap)
+    );
+
+    // toasts are composited onto the back buffer when presented
+    d2dContext->SetTarget(d2dTargetBitmap.Get());
+}
+
+void LayeredRender::ResizeSurface(UINT32 height)
+{
+    UINT32 width = (UINT32)std::ceil(boxMaxWidth);
+
+    DBG << "Resizing swap chain to " << width << "x" << height;
+
+    // nothing may hold on to the old buffers
+    d2dContext->SetTarget(nullptr);
+    d2dTargetBitmap.Reset();
+
+    d2dMultithread->Enter();
+    HRESULT hr = dxSwapChain->ResizeBuffers(0, width, height, DXGI_FORMAT_UNKNOWN, 0);
+    d2dMultithread->Leave();
+    ThrowIfFailed(hr);
+
+    CreateTargetBitmap();
+
+    // the new buffers are undefined
+    fullRedraw = true;
+    lastDamage.clear();
+}
+
 void LayeredRender::OnInit()
 {
     DBG << "Setting Window location and size";
@@ -602,6 +750,11 @@ void LayeredRender::OnInit()
 
     _stop = false;
 
+    // Post needs the event, and the thread to apply what is posted
+    DBG << "Starting render thread";
+    wakeEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    renderThread = std::thread(&LayeredRender::RenderMain, this);
+
     OnUpdate();
 
     std::wstring titleStr = L"Ա";
@@ -613,99 +766,402 @@ void LayeredRender::OnInit()
         L"\xd83e\xdc00\xD83D\xDE80"
         L"abcde\n";
 
-    AddToast(titleStr, wstr);
+    AddToast(Intern(std::wtou8(titleStr)), Intern(std::wtou8(wstr)));
 
     DBG << "Start to draw first frame";
-    PostMessage(Win32Application::GetHwnd(), WM_PAINT, 0, 0);
+    Post({ Command::Update });
+
+    if (benchmarkToasts > 0) {
+        double geometry = BenchmarkToasts(benchmarkToasts, false);
+        double atlas = BenchmarkToasts(benchmarkToasts, true);
+
+        std::string result =
+            std::to_string(benchmarkToasts) + " toasts\n"
+            "geometry: " + std::to_string((int)geometry) + " toasts/s\n"
+            "glyph atlas: " + std::to_string((int)atlas) + " toasts/s";
+
+        DBG << "Toast benchmark: " << result;
+        AddToast(Intern("Benchmark"), Intern(result));
+    }
 
     _ready = true;
 }
 
-bool LayeredRender::OnUpdate()
+double LayeredRender::BenchmarkToasts(int count, bool atlas)
 {
-    if (!_ready) {
-        return false;
+    // the pooled contexts hold their renderer, start with fresh ones
+    useGlyphAtlas = atlas;
+    {
+        std::lock_guard _(rasterLock);
+        rasterContexts.clear();
+    }
+
+    auto title = Intern("Benchmark");
+    auto text = Intern(
+        "The quick brown fox jumps over the lazy dog\n"
+        "\xe7\xad\x89\xe8\xb7\x9d\xe6\x9b\xb4\xe7\xba\xb1\xe9\xbb\x91\xe4\xbd\x93 0123456789"
+    );
+
+    // the first toast fills the atlas and the layout cache
+    Post({ Command::Remove, nullptr, AddToast(title, text) });
+
+    StopWatch watch;
+    watch.start();
+    for (int i = 0; i < count; i++) {
+        Post({ Command::Remove, nullptr, AddToast(title, text) });
     }
+    double ms = watch.stop();
 
-    if (invalidated) {
-        return true;
+    useGlyphAtlas = true;
+    {
+        std::lock_guard _(rasterLock);
+        rasterContexts.clear();
     }
 
-    std::lock_guard _(renderLock);
+    return count * 1000.0 / ms;
+}
 
-    POINT pt;
-    GetCursorPos(&pt);
+void LayeredRender::Post(Command command)
+{
+    command.postedTime = timer.ms();
+    commands.Push(std::move(command));
+    SetEvent(wakeEvent);
+}
+
+void LayeredRender::RenderMain()
+{
+    double nextFrameTime = INFINITY;
+
+    while (!_stop) {
+        DWORD timeout = INFINITE;
+        if (nextFrameTime != INFINITY) {
+            timeout = (DWORD)std::max(nextFrameTime - timer.ms(), 0.0);
+        }
+        WaitForSingleObject(wakeEvent, timeout);
+
+        if (_stop) {
+            break;
+        }
+
+        ApplyCommands();
+
+        nextFrameTime = StepAnimations(*toastList.Load());
+
+        if (invalidated) {
+            OnRender();
+        }
+    }
+}
+
+void LayeredRender::ApplyCommands()
+{
+    bool hovered = false;
+
+    uint64_t depth = 0;
+    double latency = 0.0, maxLatency = commandMaxLatencyMs.load(std::memory_order_relaxed);
+
+    Command command;
+    while (commands.Pop(command)) {
+        double waited = timer.ms() - command.postedTime;
+        depth++;
+        latency += waited;
+        maxLatency = std::max(maxLatency, waited);
+
+        switch (command.type) {
+        case Command::Add:
+            toastList.Update([&](ToastList::Version &toasts) {
+                toasts.insert(toasts.begin(), std::move(command.toast));
+            });
+            invalidated = true;
+            break;
+
+        case Command::Remove:
+            toastList.Update([&](ToastList::Version &toasts) {
+                toasts.erase(std::remove_if(toasts.begin(), toasts.end(), [&](const auto &toast) {
+                    return toast->id == command.id;
+                }), toasts.end());
+            });
+            invalidated = true;
+            break;
+
+        case Command::Hover:
+            // only the latest position matters
+            cursor = command.pt;
+            hovered = true;
+            break;
+
+        case Command::Update:
+            invalidated = true;
+            break;
+
+        case Command::Redraw:
+            redrawPending = false;
+            invalidated = true;
+            fullRedraw = true;
+            break;
+        }
+    }
+
+    // only this thread writes them, other threads only read
+    if (depth) {
+        commandsApplied.fetch_add(depth, std::memory_order_relaxed);
+        commandLatencyMs.store(commandLatencyMs.load(std::memory_order_relaxed) + latency, std::memory_order_relaxed);
+        commandMaxLatencyMs.store(maxLatency, std::memory_order_relaxed);
+        if (depth > commandsMaxDepth.load(std::memory_order_relaxed)) {
+            commandsMaxDepth.store(depth, std::memory_order_relaxed);
+        }
+    }
+
+    // toasts may also have moved under a resting cursor
+    if (!hovered && !invalidated) {
+        return;
+    }
 
     int hover = -1;
     float x = posX, y = posY;
-    for (const auto &toast : toastList) {
-        if (x <= pt.x && pt.x <= x + toast.width &&
-            y <= pt.y && pt.y <= y + toast.height) {
-            hover = toast.id;
+    for (const auto &toast : *toastList.Load()) {
+        if (x <= cursor.x && cursor.x <= x + toast->width &&
+            y <= cursor.y && cursor.y <= y + toast->height) {
+            hover = toast->id;
             break;
         }
-        y += toast.height + marginBottom;
+        y += toast->height + marginBottom;
     }
 
     if (mouseHover != hover) {
-        DBG << (hover ? "Mouse Entered" : "Mouse Leave");
+        DBG << (hover != -1 ? "Mouse Entered" : "Mouse Leave");
         invalidated = true;
         mouseHover = hover;
     }
+}
+
+bool LayeredRender::OnUpdate()
+{
+    // only sent on a display change, which may have dropped the surface contents.
+    // One pending redraw is enough, a burst of messages does not queue more.
+    if (_ready && !redrawPending.exchange(true)) {
+        Post({ Command::Redraw });
+    }
+
+    // frames are drawn by the render thread
+    return false;
+}
+
+double LayeredRender::StepAnimations(const ToastList::Version &toasts)
+{
+    double now = timer.ms();
+    double next = INFINITY;
+
+    float y = posY;
+    for (const auto &toast : toasts) {
+        // same visibility rule as OnRender, hidden toasts are not decoded at all
+        if (y > boxMaxHeight) {
+            break;
+        }
+        y += toast->height + marginBottom;
+
+        if (!toast->animation) {
+            continue;
+        }
+
+        if (toast->nextFrameTime <= now) {
+            int delay;
+            UploadFrame(*toast, toast->animation->NextFrame(delay));
+
+            toast->nextFrameTime = now + delay;
+            invalidated = true;
+        }
+
+        next = std::min(next, toast->nextFrameTime);
+    }
+
+    // the render thread sleeps until the closest frame of all animations
+    return next;
+}
+
+void LayeredRender::UploadFrame(Toast &toast, const Image &frame)
+{
+    if (!frame || frame.ch != 4) {
+        return;
+    }
+
+    // Premultiply the frame like the effect did for the first frame, then only
+    // replace that region. The box is drawn below the content when presented.
+    const int b = frame.order == Image::BGR ? 0 : 2;
+    const int r = 2 - b;
+
+    frameScratch.resize(frame.size());
+
+    const uint8_t *src = frame.data;
+    uint8_t *dst = frameScratch.data();
+    for (size_t i = 0; i < frame.size(); i += 4) {
+        int a = src[i + 3];
+
+        dst[i + 0] = (uint8_t)((src[i + b] * a + 127) / 255);
+        dst[i + 1] = (uint8_t)((src[i + 1] * a + 127) / 255);
+        dst[i + 2] = (uint8_t)((src[i + r] * a + 127) / 255);
+        dst[i + 3] = (uint8_t)a;
+    }
+
+    UINT32 pitch = frame.width * 4;
+    HRESULT hr = toast.content->CopyFromMemory(&toast.imageRect, frameScratch.data(), pitch);
+    if (FAILED(hr)) {
+        // the last frame stays, nothing changed to present
+        DBG << "Unable to upload animation frame: " << std::hex << hr;
+        return;
+    }
 
-    return invalidated;
+    toast.frame++;
 }
 
 void LayeredRender::OnRender()
 {
     TIMEIT_START(OnRender);
 
-    POINT pt;
-    GetCursorPos(&pt);
+    auto toasts = toastList.Load();
 
-    TIMEITF(OnRender, "D2D to SwapChain backbuffer", ([&] {
-        std::lock_guard _(renderLock);
+    // where the visible toasts go in this frame, relative to the surface
+    std::vector<Placement> placements;
+    {
+        float x = std::floor(posX) - surfaceOrigin.x;
+        float y = std::floor(posY) - surfaceOrigin.y;
+        for (const auto &toast : *toasts) {
+            placements.push_back(Placement{
+                toast->id,
+                ToRect(x, y, toast->width, toast->height),
+                toast->id == mouseHover,
+                toast->frame,
+                ToRect(x + toast->imageRect.left, y + toast->imageRect.top,
+                       toast->imageRect.right - toast->imageRect.left,
+                       toast->imageRect.bottom - toast->imageRect.top),
+            });
 
-        {
-            // Clear buffer
-            auto dest = D2D1_POINT_2U{ (UINT32)0, (UINT32)0 };
-            auto size = d2dEmptyBitmap->GetPixelSize();
-            auto src = D2D1_RECT_U{ 0, 0, size.width, size.height };
+            y += toast->height + marginBottom;
 
-            d2dTargetBitmap->CopyFromBitmap(
-                &dest, d2dEmptyBitmap.Get(), &src
-            );
+            if (y + surfaceOrigin.y > boxMaxHeight) {
+                break;
+            }
         }
+    }
 
-        {
-            float x = posX, y = posY;
-            for (const auto &toast : toastList) {
-                ID2D1Bitmap *bmp = toast.normal.Get();
-                if (x <= pt.x && pt.x <= x + toast.width &&
-                    y <= pt.y && pt.y <= y + toast.height) {
-                    bmp = toast.highlight.Get();
-                }
+    // grow the surface with the stack and shrink it once it is two steps too
+    // tall, rows below the window are never seen
+    {
+        LONG bottom = placements.empty() ? 0 : placements.back().rect.bottom;
+        bottom = std::max(std::min(bottom, (LONG)boxMaxHeight - surfaceOrigin.y), 0L);
+
+        UINT32 height = std::max(((UINT32)bottom + surfaceStep - 1) / surfaceStep, 1u) * surfaceStep;
+        UINT32 current = d2dTargetBitmap->GetPixelSize().height;
+        if (height > current || height + surfaceStep < current) {
+            ResizeSurface(height);
+        }
+    }
 
-                auto dest = D2D1_POINT_2U{ (UINT32)x, (UINT32)y };
-                auto src = D2D1_RECT_U{ 0, 0, toast.width, toast.height };
+    auto size = d2dTargetBitmap->GetPixelSize();
+
+    // what changed since the last frame
+    std::vector<RECT> damage;
+    if (fullRedraw) {
+        damage.push_back(RECT{ 0, 0, (LONG)size.width, (LONG)size.height });
+    } else {
+        auto find = [](const std::vector<Placement> &list, int id) -> const Placement * {
+            auto it = std::find_if(list.begin(), list.end(), [&](const Placement &p) { return p.id == id; });
+            return it == list.end() ? nullptr : &*it;
+        };
+
+        for (const auto &p : placements) {
+            const Placement *last = find(lastPlacements, p.id);
+            if (!last) {
+                damage.push_back(p.rect);
+            } else if (!EqualRect(&last->rect, &p.rect)) {
+                damage.push_back(last->rect);
+                damage.push_back(p.rect);
+            } else if (last->hovered != p.hovered) {
+                damage.push_back(p.rect);
+            } else if (last->frame != p.frame) {
+                damage.push_back(p.image);
+            }
+        }
 
-                d2dTargetBitmap->CopyFromBitmap(
-                    &dest, bmp, &src
-                );
+        for (const auto &last : lastPlacements) {
+            if (!find(placements, last.id)) {
+                damage.push_back(last.rect);
+            }
+        }
+    }
+
+    RECT bounds = { 0, 0, (LONG)size.width, (LONG)size.height };
+    ClipRects(damage, bounds);
+
+    invalidated = false;
+    fullRedraw = false;
+    lastPlacements = std::move(placements);
+
+    if (damage.empty()) {
+        TIMEIT_END(OnRender);
+        return;
+    }
+
+    // the back buffer holds the frame before the last one, so what changed in
+    // the last frame is drawn again as well
+    std::vector<RECT> redraw = damage;
+    redraw.insert(redraw.end(), lastDamage.begin(), lastDamage.end());
+    ClipRects(redraw, bounds);
+    lastDamage = damage;
+
+    TIMEITF(OnRender, "D2D to SwapChain backbuffer", ([&] {
+        d2dContext->BeginDraw();
+
+        for (const auto &r : redraw) {
+            auto clip = D2D1::RectF((FLOAT)r.left, (FLOAT)r.top, (FLOAT)r.right, (FLOAT)r.bottom);
+            d2dContext->PushAxisAlignedClip(clip, D2D1_ANTIALIAS_MODE_ALIASED);
+            d2dContext->Clear(D2D1::ColorF(D2D1::ColorF::Black, 0.f));
 
-                y += toast.height + marginBottom;
+            for (size_t i = 0; i < lastPlacements.size(); i++) {
+                const auto &toast = *(*toasts)[i];
+                const auto &p = lastPlacements[i];
 
-                if (y > boxMaxHeight) {
-                    break;
+                RECT overlap;
+                if (!IntersectRect(&overlap, &r, &p.rect)) {
+                    continue;
                 }
+
+                ID2D1SolidColorBrush *tint = p.hovered
+                    ? d2dHighlightBrush.Get()
+                    : d2dGlowBrush.Get();
+
+                // box, then the tinted glow, then text and image on top, in the
+                // order they used to be drawn into a single bitmap
+                auto box = D2D1_RECT_F{ 0.f, 0.f, (FLOAT)toast.width, (FLOAT)toast.height };
+                d2dContext->SetTransform(D2D1::Matrix3x2F::Translation((FLOAT)p.rect.left, (FLOAT)p.rect.top));
+
+                d2dContext->FillRoundedRectangle({ box, 7.f, 7.f }, d2dBoxBrush.Get());
+
+                d2dContext->SetAntialiasMode(D2D1_ANTIALIAS_MODE_ALIASED);
+                d2dContext->FillOpacityMask(toast.glow.Get(), tint, &box, &box);
+                d2dContext->SetAntialiasMode(D2D1_ANTIALIAS_MODE_PER_PRIMITIVE);
+
+                d2dContext->DrawBitmap(toast.content.Get(), &box, 1.f, D2D1_INTERPOLATION_MODE_NEAREST_NEIGHBOR, &box);
+
+                d2dContext->SetTransform(D2D1::IdentityMatrix());
             }
+
+            d2dContext->PopAxisAlignedClip();
         }
 
-        invalidated = false;
+        ThrowIfFailed(d2dContext->EndDraw());
                                                       }));
 
     TIMEITF(OnRender, "SwapChain Present", ([&] {
-        ThrowIfFailed(dxSwapChain->Present(1, 0));
+        // only the damaged rectangles are handed to the compositor
+        DXGI_PRESENT_PARAMETERS params = {};
+        params.DirtyRectsCount = (UINT)damage.size();
+        params.pDirtyRects = damage.data();
+
+        d2dMultithread->Enter();
+        HRESULT hr = dxSwapChain->Present1(1, 0, &params);
+        d2dMultithread->Leave();
+        ThrowIfFailed(hr);
                                             }));
 
     TIMEIT_END(OnRender);
@@ -717,10 +1173,25 @@ void LayeredRender::OnDestroy()
 
     _ready = false;
     _stop = true;
+
+    if (renderThread.joinable()) {
+        SetEvent(wakeEvent);
+        renderThread.join();
+    }
+
+    if (wakeEvent) {
+        CloseHandle(wakeEvent);
+        wakeEvent = NULL;
+    }
 }
 
 void LayeredRender::OnMouse(MouseEvent event, int xPos, int yPos, bool shifted, bool ctrled)
 {
+    if (event == MouseMove) {
+        Post({ Command::Hover, nullptr, -1, POINT{ xPos, yPos } });
+        return;
+    }
+
     // only handle left mouse click event when the focus of user is on desktop
     if (GetForegroundWindow() != hWorkerW || event != LButtonDown) {
         return;
@@ -732,28 +1203,27 @@ void LayeredRender::OnMouse(MouseEvent event, int xPos, int yPos, bool shifted,
 
     TIMEIT_START(OnMouse);
 
-    std::lock_guard _(renderLock);
+    auto toasts = toastList.Load();
 
     float x = posX, y = posY;
-    for (auto it = toastList.begin(); it != toastList.end(); ++it) {
-        const auto &toast = *it;
-        if (!(x <= xPos && xPos <= x + toast.width &&
-              y <= yPos && yPos <= y + toast.height)) {
-            y += toast.height + marginBottom;
+    for (const auto &toast : *toasts) {
+        if (!(x <= xPos && xPos <= x + toast->width &&
+              y <= yPos && yPos <= y + toast->height)) {
+            y += toast->height + marginBottom;
             continue;
         }
 
         if (shifted) {
             // close the message
-            toastList.erase(it);
+            Post({ Command::Remove, nullptr, toast->id });
         } else if (ctrled) {
-            std::thread([&] {
-                ShellExecute(NULL, nullptr, toast.link.c_str(),
+            // the toast may be gone before the thread runs, it gets its own copy
+            std::thread([link = std::u8tow(toast->link.str())] {
+                ShellExecute(NULL, nullptr, link.c_str(),
                              nullptr, nullptr, SW_SHOWNORMAL);
             }).detach();
         }
 
-        invalidated = true;
         break;
     }
 
@@ -762,8 +1232,10 @@ void LayeredRender::OnMouse(MouseEvent event, int xPos, int yPos, bool shifted,
 
 void LayeredRender::OnTimer(int id)
 {
-    // refresh window render
-    PostMessage(Win32Application::GetHwnd(), WM_PAINT, 0, 0);
+    // the mouse hook may not be installed, poll the cursor as well
+    POINT pt;
+    GetCursorPos(&pt);
+    Post({ Command::Hover, nullptr, -1, pt });
 
     int style = GetWindowLong(Win32Application::GetHwnd(), GWL_EXSTYLE);
     if (style & WS_EX_TOPMOST && topmostTime < timer.ms()) {
@@ -779,27 +1251,21 @@ void LayeredRender::SetTopMost(float sec)
 
 auto LayeredRender::MeasureText(const std::wstring &text) const
 {
-    wstring_char chars(text);
-
     float lineHeight = 0;
 
     std::vector<RenderCommand> commands;
-    for (const auto &[c, emoji] : chars.items()) {
-        RenderCommand cmd{ RenderCommand::Text };
 
-        if (c[0] == L'\n') {
-            commands.emplace_back(RenderCommand::TextNewline);
-            continue;
+    // one layout for every run of clusters sharing the same font
+    auto addRun = [&](std::wstring_view run, bool emoji) {
+        if (run.empty()) {
+            return;
         }
 
-        // we don't support them, skip
-        if (c[0] == L'\r' || c[0] == L'\b') {
-            continue;
-        }
+        RenderCommand cmd{ RenderCommand::Text };
 
         ThrowIfFailed(
             dwFactory->CreateTextLayout(
-                c, (UINT32)wcslen(c),
+                run.data(), (UINT32)run.size(),
                 emoji ? dwEmojiFormat.Get() : dwTextFormat.Get(),
                 boxMaxWidth, boxMaxHeight,
                 &cmd.textLayout
@@ -818,19 +1284,40 @@ auto LayeredRender::MeasureText(const std::wstring &text) const
 
         commands.emplace_back(cmd);
 
-        std::string str;
-        if (c[0] == L'\n' || c[0] == L'\r') {
-            str = "\\n";
-        } else if (emoji) {
-            str = "emoji";
-        } else {
-            str = std::wtoa(c);
-        }
-
         DBG << std::setprecision(2) << std::fixed
-            << "Text: " << str
+            << "Text: " << (emoji ? "emoji" : std::wtoa(std::wstring(run)))
             << " SIZE: " << metrics.widthIncludingTrailingWhitespace << "x" << metrics.height;
+    };
+
+    std::wstring_view view(text);
+
+    size_t runBegin = 0;
+    bool runEmoji = false;
+
+    grapheme_view clusters(view);
+    for (auto it = clusters.begin(); it != clusters.end(); ++it) {
+        const auto [c, emoji] = *it;
+
+        // a line break ends the run, \r and \b are not supported and skipped
+        bool newline = c.back() == L'\n';
+        if (newline || c[0] == L'\r' || c[0] == L'\b') {
+            addRun(view.substr(runBegin, it.offset() - runBegin), runEmoji);
+            runBegin = it.offset() + c.size();
+
+            if (newline) {
+                commands.emplace_back(RenderCommand::TextNewline);
+            }
+            continue;
+        }
+
+        if (emoji != runEmoji) {
+            addRun(view.substr(runBegin, it.offset() - runBegin), runEmoji);
+            runBegin = it.offset();
+            runEmoji = emoji;
+        }
     }
 
+    addRun(view.substr(runBegin), runEmoji);
+
     return std::tuple(lineHeight, commands);
 }
@@ -11,22 +11,46 @@
 
 #include <wrl/client.h>
 
-#include <deque>
+#include <climits>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <vector>
 
+#include "Animation.h"
 #include "Image.h"
+#include "MpscQueue.h"
+#include "SnapshotList.h"
+#include "StringTable.h"
+#include "TextLayoutCache.h"
 #include "timer.h"
 
+class GlyphAtlas;
+
+// how long commands wait in the queue for the render thread
+struct RenderCommandStats
+{
+    uint64_t applied;
+
+    // commands one ApplyCommands found waiting at most
+    uint64_t maxQueueDepth;
+
+    // from Post until applied
+    double latencyMs; // total
+    double maxLatencyMs;
+};
+
 class LayeredRender : public WindowRender
 {
 public:
     LayeredRender(int width, int height, const std::wstring &name);
 
     int AddToast(
-        const std::wstring &title, 
-        const std::wstring &text, 
-        const Image &im = Image(), 
-        const std::wstring &link = L"");
+        const InternedString &title,
+        const InternedString &text,
+        const Image &im = Image(),
+        const InternedString &link = InternedString(),
+        std::shared_ptr<Animation> animation = nullptr);
 
     void OnInit()    override;
     void OnDestroy() override;
@@ -44,21 +68,126 @@ public:
 
     void SetTopMost(float sec);
 
+    // rasterize `count` toasts with and without the glyph atlas after startup
+    // and show the rates, 0 to skip
+    void SetToastBenchmark(int count)
+    {
+        benchmarkToasts = count;
+    }
+
+    TextLayoutCache::Stats GetLayoutCacheStats() const
+    {
+        return layoutCache.GetStats();
+    }
+
+    SnapshotListStats GetToastListStats() const
+    {
+        return toastList.GetStats();
+    }
+
+    RenderCommandStats GetCommandStats() const
+    {
+        return RenderCommandStats{
+            commandsApplied.load(std::memory_order_relaxed),
+            commandsMaxDepth.load(std::memory_order_relaxed),
+            commandLatencyMs.load(std::memory_order_relaxed),
+            commandMaxLatencyMs.load(std::memory_order_relaxed),
+        };
+    }
+
 private:
     struct Toast
     {
         UINT32 width, height;
         double addedTime;
-        Microsoft::WRL::ComPtr<ID2D1Bitmap>  normal;
-        Microsoft::WRL::ComPtr<ID2D1Bitmap>  highlight;
 
+        // everything but the box and the glow, which are added when presented so
+        // hovering only changes the tint
+        Microsoft::WRL::ComPtr<ID2D1Bitmap1> content;
+        Microsoft::WRL::ComPtr<ID2D1Bitmap1> glow; // A8 coverage
+
+        int id;
+        InternedString link; // UTF-8, only converted when it is opened
+
+        // frames are streamed into the image region of both bitmaps while visible
+        std::shared_ptr<Animation> animation;
+        D2D1_RECT_U imageRect;
+        double nextFrameTime;
+
+        // counts uploaded frames, a new one only damages the image region
+        uint32_t frame = 0;
+    };
+
+    // where a toast was drawn, to find what changed in the next frame
+    struct Placement
+    {
         int id;
-        std::wstring link;
+        RECT rect;
+        bool hovered;
+        uint32_t frame;
+        RECT image;
+    };
+
+    // what the other threads ask the render thread to do
+    struct Command
+    {
+        enum Type
+        {
+            Add,    // `toast`
+            Remove, // `id`
+            Hover,  // cursor at `pt`
+            Update, // draw a new frame, only what changed
+            Redraw, // draw the whole surface, its contents may be lost
+        };
+
+        Type type;
+        std::shared_ptr<Toast> toast;
+        int id = -1;
+        POINT pt = {};
+
+        // set by Post
+        double postedTime = 0.0;
+    };
+
+    // the contexts one toast is drawn with, only used by one thread at a time
+    struct RasterContext
+    {
+        Microsoft::WRL::ComPtr<ID2D1DeviceContext4> content;
+        Microsoft::WRL::ComPtr<ID2D1DeviceContext>  glow;
+        Microsoft::WRL::ComPtr<ID2D1Effect>         premultiply;
+        Microsoft::WRL::ComPtr<IDWriteTextRenderer> textRenderer;
     };
 
     void CreateDeviceIndependentResources();
     void CreateDeviceResources();
 
+    // the back buffer as the target of d2dContext
+    void CreateTargetBitmap();
+
+    // resize the swap chain to `height` rows of the column, its contents are lost
+    void ResizeSurface(UINT32 height);
+
+    // a free context from the pool, or a new one if all are in use
+    std::unique_ptr<RasterContext> AcquireRasterContext();
+    void ReleaseRasterContext(std::unique_ptr<RasterContext> raster);
+
+    using ToastList = SnapshotList<Toast>;
+
+    // queue a command and wake the render thread
+    void Post(Command command);
+
+    // draws whenever a command or an animation frame is due, until _stop is set
+    void RenderMain();
+    void ApplyCommands();
+
+    // decode due animation frames of visible toasts, returns when the next one
+    // is due. Only on the render thread.
+    double StepAnimations(const ToastList::Version &toasts);
+    void UploadFrame(Toast &toast, const Image &frame);
+
+    // toasts per second drawn through AddToast, the toasts are removed again
+    double BenchmarkToasts(int count, bool atlas);
+
     // DXGI Resources
     Microsoft::WRL::ComPtr<IDXGIFactory2>           dxFactory;
     Microsoft::WRL::ComPtr<IDXGISwapChain1>         dxSwapChain;
@@ -75,14 +204,13 @@ private:
     Microsoft::WRL::ComPtr<ID2D1DeviceContext>      d2dContext;
     Microsoft::WRL::ComPtr<ID2D1Bitmap1>            d2dTargetBitmap;
 
-    Microsoft::WRL::ComPtr<ID2D1DeviceContext4>     d2dRTContext;
-    Microsoft::WRL::ComPtr<ID2D1BitmapRenderTarget> d2dCacheTarget;
-    Microsoft::WRL::ComPtr<ID2D1Bitmap>             d2dEmptyBitmap;
-
     Microsoft::WRL::ComPtr<ID2D1SolidColorBrush>    d2dWhiteBrush;
     Microsoft::WRL::ComPtr<ID2D1SolidColorBrush>    d2dTimeBrush;
     Microsoft::WRL::ComPtr<ID2D1SolidColorBrush>    d2dBoxBrush;
-    Microsoft::WRL::ComPtr<ID2D1Effect>             d2dEffectPremultiply;
+    Microsoft::WRL::ComPtr<ID2D1SolidColorBrush>    d2dGlowBrush;
+    Microsoft::WRL::ComPtr<ID2D1SolidColorBrush>    d2dHighlightBrush;
+
+    Microsoft::WRL::ComPtr<ID2D1Multithread>        d2dMultithread;
 
     // DirectComposition Resources
     Microsoft::WRL::ComPtr<IDCompositionDevice>     dcompDevice;
@@ -102,7 +230,11 @@ private:
     float posY = NAN;
 
     const float glowWidth = 8.f;
-    const float glowStep = 2.f;
+    const float glowStep = 4.f;
+
+    // keep distance fields of the glyphs in the atlas and look up the fill and
+    // the glow when drawing, instead of masks with the strokes baked in
+    const bool distanceFieldText = true;
 
     const D2D1::ColorF glowColor = D2D1::ColorF(0.f, 0.5f, 0.75f, 0.5f);
     const D2D1::ColorF highlightColor = D2D1::ColorF(1.f, 0.25f, 0.25f, 0.5f);
@@ -125,8 +257,6 @@ private:
                              IDWriteTextFormat **ppTextFormat) const;
 
     Microsoft::WRL::ComPtr<IDWriteFactory2>      dwFactory;
-    Microsoft::WRL::ComPtr<IDWriteTextRenderer>  dwTextRenderer;
-    Microsoft::WRL::ComPtr<IDWriteTextRenderer>  dwHighlightedRenderer;
 
     Microsoft::WRL::ComPtr<IDWriteTextFormat>    dwTitleFormat;
     Microsoft::WRL::ComPtr<IDWriteTextFormat>    dwTitleEmojiFormat;
@@ -135,18 +265,59 @@ private:
     Microsoft::WRL::ComPtr<IDWriteTextFormat>    dwEmojiFormat;
     Microsoft::WRL::ComPtr<IDWriteTextFormat>    dwTimeStampFormat;
 
+    // title and text layouts, the timestamp changes every second and is not cached
+    TextLayoutCache layoutCache;
+
+    std::shared_ptr<GlyphAtlas> glyphAtlas;
+
+    // new raster contexts draw glyphs from the atlas, only off for the benchmark
+    std::atomic<bool> useGlyphAtlas = true;
+    int benchmarkToasts = 0;
+
+    std::mutex rasterLock;
+    std::vector<std::unique_ptr<RasterContext>> rasterContexts;
+
     std::atomic<bool> _ready;
     std::atomic<bool> _stop;
     std::atomic<int> _counter = 0;
 
-    std::mutex renderLock;
-    std::deque<Toast> toastList;
+    // newest first, only changed by the render thread (the single writer) and
+    // read by any thread
+    ToastList toastList;
     std::atomic<bool> invalidated;
 
+    // a Redraw from OnUpdate is queued and not applied yet
+    std::atomic<bool> redrawPending = false;
+
+    // the message pump and the HTTP workers only talk to the render thread
+    // through the queue, the event wakes it up
+    MpscQueue<Command> commands;
+    HANDLE wakeEvent = NULL;
+    std::thread renderThread;
+
+    // only written by the render thread, a stalled render thread shows up here
+    std::atomic<uint64_t> commandsApplied = 0;
+    std::atomic<uint64_t> commandsMaxDepth = 0;
+    std::atomic<double> commandLatencyMs = 0.0;
+    std::atomic<double> commandMaxLatencyMs = 0.0;
+
     StopWatch timer;
     std::atomic<double> topmostTime;
 
+    // the rest is only used by the render thread
     int mouseHover = -1;
+    POINT cursor = { LONG_MIN, LONG_MIN };
+
+    // damage tracking, the whole surface is drawn until the first frame is out
+    bool fullRedraw = true;
+    std::vector<Placement> lastPlacements;
+    std::vector<RECT> lastDamage;
+
+    // the swap chain only covers the toast column, which starts here in the window
+    POINT surfaceOrigin = {};
+
+    // frame premultiplied for upload
+    std::vector<uint8_t> frameScratch;
 
     HWND hWorkerW;
 
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+// Unbounded queue with any number of producers and one consumer (Vyukov's
+// node based MPSC queue). Push never blocks and never waits for the consumer.
+// A push that is not linked yet looks like an empty queue to Pop, so the
+// producer has to wake the consumer after pushing, not before.
+template<typename T>
+class MpscQueue
+{
+public:
+    MpscQueue()
+    {
+        Node *stub = new Node();
+        head.store(stub, std::memory_order_relaxed);
+        tail = stub;
+    }
+
+    ~MpscQueue()
+    {
+        T value;
+        while (Pop(value)) {}
+        delete tail;
+    }
+
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    void Push(T value)
+    {
+        Node *node = new Node{ std::move(value) };
+        Node *prev = head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // only from the consumer thread
+    bool Pop(T &value)
+    {
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if (!next) {
+            return false;
+        }
+
+        // `next` becomes the new stub, its value is moved out
+        value = std::move(next->value);
+        delete tail;
+        tail = next;
+        return true;
+    }
+
+private:
+    struct Node
+    {
+        T value;
+        std::atomic<Node *> next = nullptr;
+    };
+
+    std::atomic<Node *> head;
+    Node *tail;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct SnapshotListStats
+{
+    uint64_t reads;
+    uint64_t versions;
+    size_t size;
+};
+
+// Copy-on-write list with a single writer, readers on any thread. Readers take
+// the current version without waiting for the writer and keep it alive as long
+// as they hold it. The writer copies the version, changes the copy and
+// publishes it. The toast list is only written by the render thread, which
+// applies the commands the other threads queue for it.
+//
+// Elements are shared between versions, so their members must only be
+// changed by one thread.
+template<typename T>
+class SnapshotList
+{
+public:
+    using Version = std::vector<std::shared_ptr<T>>;
+    using Stats = SnapshotListStats;
+
+    SnapshotList() :
+        current(std::make_shared<const Version>())
+    {}
+
+    std::shared_ptr<const Version> Load() const
+    {
+        reads.fetch_add(1, std::memory_order_relaxed);
+        return std::atomic_load(&current);
+    }
+
+    // calls `update` with a copy of the current version and publishes it, only
+    // from the writer thread
+    template<typename F>
+    void Update(F &&update)
+    {
+        auto next = std::make_shared<Version>(*std::atomic_load(&current));
+        update(*next);
+
+        std::atomic_store(&current, std::shared_ptr<const Version>(std::move(next)));
+        versions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Stats GetStats() const
+    {
+        return Stats{
+            reads.load(std::memory_order_relaxed),
+            versions.load(std::memory_order_relaxed),
+            std::atomic_load(&current)->size(),
+        };
+    }
+
+private:
+    std::shared_ptr<const Version> current;
+
+    mutable std::atomic<uint64_t> reads = 0;
+    std::atomic<uint64_t> versions = 0;
+};
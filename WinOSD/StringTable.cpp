@@ -0,0 +1,70 @@
+#include "StringTable.h"
+
+StringTable &StringTable::Global()
+{
+    static StringTable *table = new StringTable();
+    return *table;
+}
+
+InternedString StringTable::Intern(std::string_view str)
+{
+    if (str.empty()) {
+        return InternedString();
+    }
+
+    size_t hash = std::hash<std::string_view>()(str);
+    Shard &shard = shards[hash % shardCount];
+
+    std::lock_guard _(shard.lock);
+
+    auto it = shard.strings.find(str);
+    if (it != shard.strings.end()) {
+        if (auto handle = it->second.handle.lock()) {
+            ++shard.hits;
+            return InternedString(std::move(handle));
+        }
+
+        // the last handle is gone but its deleter has not got the lock yet,
+        // the key still points into that string so the entry is replaced
+        shard.bytes -= it->first.size();
+        shard.strings.erase(it);
+    }
+
+    ++shard.misses;
+
+    auto *owned = new std::string(str);
+    std::shared_ptr<const std::string> handle(owned, [this, &shard](const std::string *s) {
+        Release(shard, s);
+        delete s;
+    });
+
+    shard.strings.emplace(std::string_view(*owned), Slot{ owned, handle });
+    shard.bytes += owned->size();
+
+    return InternedString(std::move(handle));
+}
+
+void StringTable::Release(Shard &shard, const std::string *str)
+{
+    std::lock_guard _(shard.lock);
+
+    // the entry may have been replaced by a new string with the same content
+    auto it = shard.strings.find(*str);
+    if (it != shard.strings.end() && it->second.str == str) {
+        shard.bytes -= str->size();
+        shard.strings.erase(it);
+    }
+}
+
+StringTable::Stats StringTable::GetStats() const
+{
+    Stats stats = {};
+    for (const auto &shard : shards) {
+        std::lock_guard _(shard.lock);
+        stats.hits += shard.hits;
+        stats.misses += shard.misses;
+        stats.entries += shard.strings.size();
+        stats.bytes += shard.bytes;
+    }
+    return stats;
+}
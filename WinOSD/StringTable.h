@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Handle to a string in the StringTable. Equal strings interned while one of
+// them is alive share the same handle, so comparing and hashing only look at
+// the pointer. The default handle is the empty string.
+class InternedString
+{
+public:
+    InternedString() = default;
+
+    const std::string &str() const
+    {
+        static const std::string empty;
+        return ptr ? *ptr : empty;
+    }
+
+    std::string_view view() const
+    {
+        return str();
+    }
+
+    bool empty() const
+    {
+        return !ptr || ptr->empty();
+    }
+
+    // stable for the lifetime of the string, usable as a cache key
+    uintptr_t id() const
+    {
+        return (uintptr_t)ptr.get();
+    }
+
+    bool operator==(const InternedString &other) const
+    {
+        return ptr == other.ptr;
+    }
+
+    bool operator!=(const InternedString &other) const
+    {
+        return ptr != other.ptr;
+    }
+
+private:
+    friend class StringTable;
+
+    explicit InternedString(std::shared_ptr<const std::string> ptr) :
+        ptr(std::move(ptr))
+    {}
+
+    std::shared_ptr<const std::string> ptr;
+};
+
+namespace std {
+template<>
+struct hash<InternedString>
+{
+    size_t operator()(const InternedString &s) const
+    {
+        return hash<uintptr_t>()(s.id());
+    }
+};
+}
+
+// Concurrent intern table for the strings repeated across toasts, like titles
+// and links. It is split into shards with their own lock, and a string leaves
+// the table when its last handle is released.
+class StringTable
+{
+public:
+    struct Stats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        size_t entries;
+        size_t bytes;
+    };
+
+    // the process wide table, never destroyed so handles in static objects stay valid
+    static StringTable &Global();
+
+    InternedString Intern(std::string_view str);
+
+    Stats GetStats() const;
+
+private:
+    static constexpr size_t shardCount = 16;
+
+    struct Slot
+    {
+        // identifies the string the key points into, the weak pointer alone
+        // cannot tell an expired entry from its replacement
+        const std::string *str;
+        std::weak_ptr<const std::string> handle;
+    };
+
+    struct Shard
+    {
+        mutable std::mutex lock;
+
+        // keys point into the interned strings
+        std::unordered_map<std::string_view, Slot> strings;
+        size_t bytes = 0;
+
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
+    void Release(Shard &shard, const std::string *str);
+
+    Shard shards[shardCount];
+};
+
+inline InternedString Intern(std::string_view str)
+{
+    return StringTable::Global().Intern(str);
+}
@@ -0,0 +1,126 @@
+#include "TextLayoutCache.h"
+
+#include <cfloat>
+#include <vector>
+
+#include "hash.h"
+#include "logging.h"
+#include "strings.h"
+
+namespace {
+// DirectWrite does not tell how much a layout holds on to, so count what the
+// shaped layout has to keep: a copy of the text with its script, bidi and line
+// break analysis, every cluster with its glyph ids, advances and offsets, and
+// the lines. The fixed part is the layout object with its format properties.
+constexpr size_t layoutOverhead = 1024;
+constexpr size_t analysisPerChar = sizeof(wchar_t) + 4;
+constexpr size_t glyphSize = sizeof(UINT16) + sizeof(FLOAT) + sizeof(DWRITE_GLYPH_OFFSET);
+
+size_t LayoutSize(IDWriteTextLayout *layout, size_t length, UINT32 lineCount)
+{
+    // only asks for the count, fails with E_NOT_SUFFICIENT_BUFFER
+    UINT32 clusterCount = 0;
+    layout->GetClusterMetrics(nullptr, 0, &clusterCount);
+
+    return layoutOverhead
+        + length * analysisPerChar
+        + clusterCount * (sizeof(DWRITE_CLUSTER_METRICS) + glyphSize)
+        + lineCount * sizeof(DWRITE_LINE_METRICS);
+}
+}
+
+size_t TextLayoutCache::KeyHash::operator()(const Key &key) const
+{
+    uint64_t fields[] = {
+        (uint64_t)key.text,
+        (uint64_t)(uintptr_t)key.format,
+        (uint64_t)std::hash<float>()(key.maxWidth),
+    };
+    return (size_t)hash::xxh64(fields, sizeof(fields));
+}
+
+TextLayoutCache::TextLayoutCache(size_t budget) :
+    budget(budget)
+{}
+
+CachedLayout TextLayoutCache::Get(IDWriteFactory *factory, const InternedString &text, IDWriteTextFormat *format,
+                                  float maxWidth)
+{
+    Key key{ text.id(), format, maxWidth };
+
+    {
+        std::lock_guard _(lock);
+
+        auto it = index.find(key);
+        if (it != index.end()) {
+            ++hits;
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->layout;
+        }
+
+        ++misses;
+    }
+
+    // shape outside of the lock, it is the slow part
+    thread_local std::wstring buffer;
+    auto wtext = std::u8tow(text.view(), buffer);
+
+    CachedLayout result;
+    ThrowIfFailed(
+        factory->CreateTextLayout(
+            wtext.data(), (UINT32)wtext.size(),
+            format,
+            maxWidth, FLT_MAX,
+            &result.layout
+        )
+    );
+
+    ThrowIfFailed(result.layout->GetMetrics(&result.metrics));
+
+    UINT32 lineCount = result.metrics.lineCount;
+    if (lineCount > 0) {
+        std::vector<DWRITE_LINE_METRICS> lineMetrics(lineCount);
+        ThrowIfFailed(result.layout->GetLineMetrics(lineMetrics.data(), lineCount, &lineCount));
+        result.lastLineHeight = lineMetrics.back().height;
+    }
+
+    size_t size = LayoutSize(result.layout.Get(), wtext.size(), result.metrics.lineCount);
+    if (size > budget) {
+        return result;
+    }
+
+    std::lock_guard _(lock);
+
+    auto it = index.find(key);
+    if (it != index.end()) {
+        // another toast shaped the same text concurrently
+        lru.splice(lru.begin(), lru, it->second);
+        return it->second->layout;
+    }
+
+    lru.push_front(Entry{ key, text, result, size });
+    index.emplace(key, lru.begin());
+    bytes += size;
+
+    Evict();
+
+    return result;
+}
+
+void TextLayoutCache::Evict()
+{
+    while (bytes > budget && !lru.empty()) {
+        auto &entry = lru.back();
+        DBG << "Evict cached layout \"" << entry.text.str().substr(0, 32) << "\"";
+
+        bytes -= entry.bytes;
+        index.erase(entry.key);
+        lru.pop_back();
+    }
+}
+
+TextLayoutCache::Stats TextLayoutCache::GetStats() const
+{
+    std::lock_guard _(lock);
+    return Stats{ hits, misses, lru.size(), bytes, budget };
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <dwrite_2.h>
+#include <wrl/client.h>
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "StringTable.h"
+
+struct CachedLayout
+{
+    Microsoft::WRL::ComPtr<IDWriteTextLayout> layout;
+    DWRITE_TEXT_METRICS metrics = {};
+
+    // height of the last line, the image is placed one line below the text
+    float lastLineHeight = 0.f;
+
+    explicit operator bool() const
+    {
+        return layout != nullptr;
+    }
+};
+
+// LRU of finished text layouts keyed by the interned text, the format and the
+// wrapping width, so repeated titles and bodies are shaped only once. Layouts
+// are not limited in height, toasts clip them to the room they have left, so
+// the same text hits no matter where it starts in the box. Layouts are never
+// modified after they are created and may be drawn by any toast.
+class TextLayoutCache
+{
+public:
+    struct Stats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        size_t entries;
+        size_t bytes;
+        size_t budget;
+    };
+
+    TextLayoutCache(size_t budget = 4 * 1024 * 1024);
+
+    // the cached layout, or a new one shaped by `factory`
+    CachedLayout Get(IDWriteFactory *factory, const InternedString &text, IDWriteTextFormat *format,
+                     float maxWidth);
+
+    Stats GetStats() const;
+
+private:
+    struct Key
+    {
+        uintptr_t text;
+        IDWriteTextFormat *format;
+        float maxWidth;
+
+        bool operator==(const Key &other) const
+        {
+            return text == other.text && format == other.format && maxWidth == other.maxWidth;
+        }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key &key) const;
+    };
+
+    struct Entry
+    {
+        Key key;
+
+        // keeps the key alive, the handle id would be reused once it is freed
+        InternedString text;
+        CachedLayout layout;
+        size_t bytes;
+    };
+
+    void Evict();
+
+    mutable std::mutex lock;
+
+    // front is the most recently used
+    std::list<Entry> lru;
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+
+    size_t budget;
+    size_t bytes = 0;
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
@@ -189,6 +189,16 @@ LRESULT CALLBACK Win32Application::WindowProc(HWND hWnd, UINT message, WPARAM wP
         return 0;
 
     case WM_PAINT:
+    {
+        // the render thread draws into the composition visual, there is nothing
+        // to paint here. The region still has to be validated, otherwise Windows
+        // keeps sending WM_PAINT.
+        PAINTSTRUCT ps;
+        BeginPaint(hWnd, &ps);
+        EndPaint(hWnd, &ps);
+    }
+    return 0;
+
     case WM_DISPLAYCHANGE:
         if (pRenderer) {
 #if SHOW_FPS
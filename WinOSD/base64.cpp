@@ -0,0 +1,365 @@
+#include "base64.h"
+
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BASE64_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC allows every intrinsic in any function
+#define BASE64_TARGET(isa)
+#else
+#define BASE64_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace base64
+{
+namespace
+{
+// Every block decoder returns the number of characters of `src` it decoded,
+// always a multiple of 4. It stops in front of the first block containing
+// a character outside of the alphabet (including '='), the scalar path
+// then finds the exact offset or handles the padding.
+using block_decoder = std::size_t (*)(unsigned char *out, unsigned char const *src, std::size_t len);
+
+std::size_t
+decode_blocks_scalar(unsigned char *out, unsigned char const *src, std::size_t len)
+{
+    auto const inverse = get_inverse();
+
+    std::size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        int a = inverse[src[i]];
+        int b = inverse[src[i + 1]];
+        int c = inverse[src[i + 2]];
+        int d = inverse[src[i + 3]];
+        if ((a | b | c | d) < 0)
+            break;
+
+        std::uint32_t v = (std::uint32_t)a << 18 | (std::uint32_t)b << 12 | (std::uint32_t)c << 6 | (std::uint32_t)d;
+        *out++ = (unsigned char)(v >> 16);
+        *out++ = (unsigned char)(v >> 8);
+        *out++ = (unsigned char)v;
+    }
+
+    return i;
+}
+
+#ifdef BASE64_X86
+// Classify every character by its nibbles, see Wojciech Mula and Daniel Lemire,
+// "Faster Base64 Encoding and Decoding Using AVX2 Instructions"
+BASE64_TARGET("ssse3")
+std::size_t
+decode_blocks_ssse3(unsigned char *out, unsigned char const *src, std::size_t len)
+{
+    const __m128i lut_lo = _mm_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi = _mm_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71,
+        0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i pack = _mm_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    std::size_t i = 0;
+
+    // 16 bytes are stored for 12 octets, the spare 4 are covered by the next block
+    for (; i + 24 <= len; i += 16) {
+        __m128i in = _mm_loadu_si128((const __m128i *)(src + i));
+
+        __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0F));
+        __m128i lo_nibbles = _mm_and_si128(in, _mm_set1_epi8(0x0F));
+
+        __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+        __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+        if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())))
+            break;
+
+        __m128i eq_2f = _mm_cmpeq_epi8(in, _mm_set1_epi8(0x2F));
+        __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+        __m128i values = _mm_add_epi8(in, roll);
+
+        // 4 x 6 bits into 3 octets
+        __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+        __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+
+        _mm_storeu_si128((__m128i *)out, _mm_shuffle_epi8(packed, pack));
+        out += 12;
+    }
+
+    return i + decode_blocks_scalar(out, src + i, len - i);
+}
+
+BASE64_TARGET("avx2")
+std::size_t
+decode_blocks_avx2(unsigned char *out, unsigned char const *src, std::size_t len)
+{
+    const __m256i lut_lo = _mm256_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lut_hi = _mm256_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71,
+        0, 0, 0, 0, 0, 0, 0, 0,
+        0, 16, 19, 4, -65, -65, -71, -71,
+        0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i pack = _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1);
+
+    std::size_t i = 0;
+
+    // 32 bytes are stored for 24 octets, the spare 8 are covered by the next block
+    for (; i + 44 <= len; i += 32) {
+        __m256i in = _mm256_loadu_si256((const __m256i *)(src + i));
+
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), _mm256_set1_epi8(0x0F));
+        __m256i lo_nibbles = _mm256_and_si256(in, _mm256_set1_epi8(0x0F));
+
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        if (!_mm256_testz_si256(lo, hi))
+            break;
+
+        __m256i eq_2f = _mm256_cmpeq_epi8(in, _mm256_set1_epi8(0x2F));
+        __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+        __m256i values = _mm256_add_epi8(in, roll);
+
+        __m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        __m256i packed = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+
+        // 12 octets in each lane, then the two lanes back to back
+        packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(packed, pack), lanes);
+
+        _mm256_storeu_si256((__m256i *)out, packed);
+        out += 24;
+    }
+
+    return i + decode_blocks_ssse3(out, src + i, len - i);
+}
+
+bool
+has_avx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 6) != 6)
+        return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+bool
+has_ssse3()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0;
+#else
+    return __builtin_cpu_supports("ssse3");
+#endif
+}
+#endif
+
+block_decoder
+select_block_decoder()
+{
+#ifdef BASE64_X86
+    if (has_avx2())
+        return decode_blocks_avx2;
+    if (has_ssse3())
+        return decode_blocks_ssse3;
+#endif
+    return decode_blocks_scalar;
+}
+
+std::size_t
+decode_blocks(unsigned char *out, unsigned char const *src, std::size_t len)
+{
+    static block_decoder const decode = select_block_decoder();
+    return decode(out, src, len);
+}
+} // namespace
+
+bool
+detail::supported(isa set)
+{
+    switch (set) {
+#ifdef BASE64_X86
+    case isa::avx2:
+        return has_avx2();
+    case isa::ssse3:
+        return has_ssse3();
+#endif
+    case isa::scalar:
+        return true;
+    default:
+        return false;
+    }
+}
+
+std::size_t
+detail::decode_blocks(isa set, unsigned char *out, unsigned char const *src, std::size_t len)
+{
+    switch (set) {
+#ifdef BASE64_X86
+    case isa::avx2:
+        return decode_blocks_avx2(out, src, len);
+    case isa::ssse3:
+        return decode_blocks_ssse3(out, src, len);
+#endif
+    default:
+        return decode_blocks_scalar(out, src, len);
+    }
+}
+
+bool
+decoder::push(unsigned char c, unsigned char *&out)
+{
+    // nothing may follow the padding
+    if (done_)
+        return false;
+
+    if (c == '=') {
+        if (count_ < 2)
+            return false;
+        ++padding_;
+        quad_[count_++] = 0;
+    } else {
+        auto const v = get_inverse()[c];
+        if (v == -1 || padding_)
+            return false;
+        quad_[count_++] = (unsigned char)v;
+    }
+
+    if (count_ == 4) {
+        unsigned char c3[3];
+        c3[0] = (quad_[0] << 2) + ((quad_[1] & 0x30) >> 4);
+        c3[1] = ((quad_[1] & 0xf) << 4) + ((quad_[2] & 0x3c) >> 2);
+        c3[2] = ((quad_[2] & 0x3) << 6) + quad_[3];
+
+        for (int i = 0; i < 3 - padding_; i++)
+            *out++ = c3[i];
+
+        count_ = 0;
+        done_ = padding_ != 0;
+    }
+
+    return true;
+}
+
+decode_result
+decoder::feed(void *dest, char const *src, std::size_t len)
+{
+    auto const begin = static_cast<unsigned char *>(dest);
+    auto const in = reinterpret_cast<unsigned char const *>(src);
+    auto out = begin;
+
+    decode_result result;
+    if (error_ != decode_result::npos) {
+        result.error = error_;
+        return result;
+    }
+
+    std::size_t i = 0;
+
+    // complete the block left over from the previous chunk
+    for (; count_ != 0 && i < len; i++) {
+        if (!push(in[i], out)) {
+            error_ = offset_ + i;
+            break;
+        }
+    }
+
+    if (error_ == decode_result::npos && !done_) {
+        std::size_t n = decode_blocks(out, in + i, (len - i) & ~std::size_t(3));
+        out += n / 4 * 3;
+        i += n;
+
+        // the padding, the tail and the exact position of an error
+        for (; i < len; i++) {
+            if (!push(in[i], out)) {
+                error_ = offset_ + i;
+                break;
+            }
+        }
+    } else if (error_ == decode_result::npos && i < len) {
+        error_ = offset_ + i;
+    }
+
+    offset_ += len;
+
+    result.written = out - begin;
+    result.error = error_;
+    return result;
+}
+
+decode_result
+decoder::finish(void *dest)
+{
+    auto out = static_cast<unsigned char *>(dest);
+
+    decode_result result;
+    if (error_ != decode_result::npos || count_ == 0) {
+        result.error = error_;
+        return result;
+    }
+
+    // a single character is not a whole octet, and a padded block must be complete
+    if (count_ == 1 || padding_) {
+        error_ = offset_ - count_;
+        result.error = error_;
+        return result;
+    }
+
+    unsigned char c3[2];
+    c3[0] = (quad_[0] << 2) + ((quad_[1] & 0x30) >> 4);
+    c3[1] = ((quad_[1] & 0xf) << 4) + ((quad_[2] & 0x3c) >> 2);
+
+    for (int i = 0; i < count_ - 1; i++)
+        *out++ = c3[i];
+
+    result.written = count_ - 1;
+    count_ = 0;
+    done_ = true;
+    return result;
+}
+
+decode_result
+strict_decode(void *dest, char const *src, std::size_t len)
+{
+    decoder d;
+
+    auto result = d.feed(dest, src, len);
+    if (!result.ok())
+        return result;
+
+    auto tail = d.finish(static_cast<unsigned char *>(dest) + result.written);
+    result.written += tail.written;
+    result.error = tail.error;
+    return result;
+}
+} // base64
@@ -172,6 +172,108 @@ decode(void *dest, char const *src, std::size_t len)
     return { out - static_cast<char *>(dest),
         in - reinterpret_cast<unsigned char const *>(src) };
 }
+
+/// Returns max bytes needed by `strict_decode` and `decoder::feed`
+inline
+std::size_t constexpr
+max_decoded_size(std::size_t n)
+{
+    return (n + 3) / 4 * 3;
+}
+
+/// Result of a validating decode
+struct decode_result
+{
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    /// The number of octets written to `out`
+    std::size_t written = 0;
+
+    /// Offset of the first invalid character in the whole input, or `npos`
+    std::size_t error = npos;
+
+    bool ok() const
+    {
+        return error == npos;
+    }
+};
+
+/** Validating base64 decoder which can be fed arbitrary chunks.
+
+    The input must only consist of the base64 alphabet, with up to two
+    `=` at the very end. A missing padding is accepted, anything else,
+    including whitespace, is an error. Whole blocks are decoded with
+    SSSE3 or AVX2 when the CPU supports it.
+*/
+class decoder
+{
+public:
+    /** Decode the next chunk of the input.
+
+        @par Requires
+
+        The memory pointed to by `dest` points to valid memory
+        of at least `max_decoded_size(len)` bytes.
+
+        Once an error is reported, every further call reports it again.
+    */
+    decode_result
+    feed(void *dest, char const *src, std::size_t len);
+
+    /** Flush an unpadded tail, at most 2 octets are written.
+
+        Reports an error if the input ended in the middle of a block.
+    */
+    decode_result
+    finish(void *dest);
+
+private:
+    bool
+    push(unsigned char c, unsigned char *&out);
+
+    unsigned char quad_[4] = {};
+    int count_ = 0;
+    int padding_ = 0;
+    bool done_ = false;
+
+    std::size_t offset_ = 0;
+    std::size_t error_ = decode_result::npos;
+};
+
+/** Decode and validate a whole base64 string.
+
+    @par Requires
+
+    The memory pointed to by `out` points to valid memory
+    of at least `max_decoded_size(len)` bytes.
+*/
+decode_result
+strict_decode(void *dest, char const *src, std::size_t len);
+
+namespace detail
+{
+/// Instruction sets of the block decoders behind `decoder`
+enum class isa
+{
+    scalar,
+    ssse3,
+    avx2,
+};
+
+/// Whether the CPU can run the block decoder for `set`
+bool
+supported(isa set);
+
+/** Decode whole blocks of 4 characters with the decoder for `set`.
+
+    Stops in front of the first block containing a character outside
+    of the alphabet, including '='.
+
+    @return The number of characters decoded, a multiple of 4.
+*/
+std::size_t
+decode_blocks(isa set, unsigned char *out, unsigned char const *src, std::size_t len);
+} // detail
 } // base64
 
 template<class = void>
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "unicode_tables.h"
+
+// Extended grapheme cluster segmentation (UAX #29) and emoji classification
+// on top of the generated property tables in unicode_tables.h. Regenerate the
+// tables with scripts/gen_unicode_tables.py when moving to a new Unicode version.
+namespace unicode
+{
+// the order matches GRAPHEME_BREAK in scripts/gen_unicode_tables.py
+enum class GraphemeBreak : uint8_t
+{
+    Other, CR, LF, Control, Extend, ZWJ, RegionalIndicator,
+    Prepend, SpacingMark, L, V, T, LV, LVT,
+};
+
+// Indic_Conjunct_Break, the order matches INCB
+enum class InCB : uint8_t
+{
+    None, Linker, Consonant, Extend,
+};
+
+struct Properties
+{
+    uint8_t bits = 0;
+
+    constexpr GraphemeBreak graphemeBreak() const
+    {
+        return (GraphemeBreak)(bits & 0x0F);
+    }
+
+    constexpr bool extendedPictographic() const
+    {
+        return (bits & 0x10) != 0;
+    }
+
+    constexpr InCB incb() const
+    {
+        return (InCB)(bits >> 5 & 3);
+    }
+};
+
+constexpr Properties GetProperties(char32_t cp)
+{
+    if (cp > 0x10FFFF) {
+        return {};
+    }
+
+    constexpr uint32_t mask = (1u << tables::blockShift) - 1;
+    return { tables::stage2[(size_t)tables::stage1[cp >> tables::blockShift] << tables::blockShift | (cp & mask)] };
+}
+
+// Feed code points one by one, tells whether a new cluster starts in front of each
+class GraphemeBreaker
+{
+public:
+    bool next(char32_t cp)
+    {
+        return next(GetProperties(cp));
+    }
+
+    bool next(Properties cur)
+    {
+        using GB = GraphemeBreak;
+
+        const GB a = prev.graphemeBreak();
+        const GB b = cur.graphemeBreak();
+
+        bool boundary;
+        if (first) {
+            boundary = true; // GB1
+        } else if (a == GB::CR && b == GB::LF) {
+            boundary = false; // GB3
+        } else if (IsControl(a) || IsControl(b)) {
+            boundary = true; // GB4, GB5
+        } else if (a == GB::L && (b == GB::L || b == GB::V || b == GB::LV || b == GB::LVT)) {
+            boundary = false; // GB6
+        } else if ((a == GB::LV || a == GB::V) && (b == GB::V || b == GB::T)) {
+            boundary = false; // GB7
+        } else if ((a == GB::LVT || a == GB::T) && b == GB::T) {
+            boundary = false; // GB8
+        } else if (b == GB::Extend || b == GB::ZWJ || b == GB::SpacingMark || a == GB::Prepend) {
+            boundary = false; // GB9, GB9a, GB9b
+        } else if (conjunct == Conjunct::Linked && cur.incb() == InCB::Consonant) {
+            boundary = false; // GB9c
+        } else if (emoji == Emoji::Joined && cur.extendedPictographic()) {
+            boundary = false; // GB11
+        } else if (a == GB::RegionalIndicator && b == GB::RegionalIndicator) {
+            boundary = regionalIndicators % 2 == 0; // GB12, GB13
+        } else {
+            boundary = true; // GB999
+        }
+
+        // the states for the rules looking further back than one code point
+
+        regionalIndicators = b == GB::RegionalIndicator ? regionalIndicators + 1 : 0;
+
+        if (cur.extendedPictographic()) {
+            emoji = Emoji::Pictographic;
+        } else if (emoji == Emoji::Pictographic && b == GB::Extend) {
+            // Extended_Pictographic Extend*
+        } else if (emoji == Emoji::Pictographic && b == GB::ZWJ) {
+            emoji = Emoji::Joined;
+        } else {
+            emoji = Emoji::None;
+        }
+
+        if (cur.incb() == InCB::Consonant) {
+            conjunct = Conjunct::Consonant;
+        } else if (conjunct != Conjunct::None && cur.incb() == InCB::Linker) {
+            conjunct = Conjunct::Linked;
+        } else if (conjunct == Conjunct::None || cur.incb() != InCB::Extend) {
+            conjunct = Conjunct::None;
+        }
+
+        prev = cur;
+        first = false;
+        return boundary;
+    }
+
+    void reset()
+    {
+        *this = GraphemeBreaker();
+    }
+
+private:
+    enum class Emoji : uint8_t
+    {
+        None,
+        Pictographic, // Extended_Pictographic Extend*
+        Joined,       // Extended_Pictographic Extend* ZWJ
+    };
+
+    enum class Conjunct : uint8_t
+    {
+        None,
+        Consonant, // Consonant [Extend Linker]*, no linker yet
+        Linked,    // Consonant [Extend Linker]* Linker [Extend Linker]*
+    };
+
+    static constexpr bool IsControl(GraphemeBreak gb)
+    {
+        return gb == GraphemeBreak::Control || gb == GraphemeBreak::CR || gb == GraphemeBreak::LF;
+    }
+
+    Properties prev;
+    bool first = true;
+    Emoji emoji = Emoji::None;
+    Conjunct conjunct = Conjunct::None;
+    size_t regionalIndicators = 0;
+};
+
+// Decodes the code point at text[i] and moves i past it, a lone surrogate decodes as itself
+template<typename Char>
+constexpr char32_t DecodeUtf16(const Char *text, size_t len, size_t &i)
+{
+    char32_t c = (uint16_t)text[i++];
+    if (c >= 0xD800 && c <= 0xDBFF && i < len) {
+        char32_t c2 = (uint16_t)text[i];
+        if (c2 >= 0xDC00 && c2 <= 0xDFFF) {
+            i++;
+            return 0x10000 + ((c - 0xD800) << 10 | (c2 - 0xDC00));
+        }
+    }
+    return c;
+}
+
+// Returns the end of the cluster starting at `pos` in UTF-16 text. `emoji` is set
+// if the cluster should be drawn with an emoji font: it starts with a pictographic
+// character or a flag, or asks for emoji presentation with VS16 or a keycap, and
+// does not ask for text presentation with VS15.
+template<typename Char>
+size_t NextGrapheme(const Char *text, size_t len, size_t pos, bool *emoji = nullptr)
+{
+    if (pos >= len) {
+        return len;
+    }
+
+    GraphemeBreaker breaker;
+
+    size_t i = pos;
+    char32_t cp = DecodeUtf16(text, len, i);
+    Properties p = GetProperties(cp);
+    breaker.next(p);
+
+    bool pictographic = p.extendedPictographic() || p.graphemeBreak() == GraphemeBreak::RegionalIndicator;
+    bool textStyle = false;
+
+    while (i < len) {
+        size_t end = i;
+        cp = DecodeUtf16(text, len, i);
+        if (breaker.next(cp)) {
+            i = end;
+            break;
+        }
+
+        if (cp == 0xFE0F || cp == 0x20E3) {
+            pictographic = true;
+        } else if (cp == 0xFE0E) {
+            textStyle = true;
+        }
+    }
+
+    if (emoji) {
+        *emoji = pictographic && !textStyle;
+    }
+
+    return i;
+}
+}
@@ -8,6 +8,8 @@
 
 #ifdef _WIN32
 #include <windows.h>
+#else
+#define _vsnprintf vsnprintf
 #endif
 
 inline void dprint(const char *str)
@@ -17,6 +17,13 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
     int argc;
     LPWSTR *argv = CommandLineToArgvW(GetCommandLineW(), &argc);
     // command line argument handling
+    int benchmarkToasts = 0;
+    for (int i = 1; i + 1 < argc; i++) {
+        // --bench-toasts N times N toasts with and without the glyph atlas
+        if (wcscmp(argv[i], L"--bench-toasts") == 0) {
+            benchmarkToasts = _wtoi(argv[++i]);
+        }
+    }
 
     LocalFree(argv);
 
@@ -24,6 +31,7 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
     GetWindowRect(GetDesktopWindow(), &screenSize);
     LayeredRender app(screenSize.right, screenSize.bottom, L"PopupMessage");
 
+    app.SetToastBenchmark(benchmarkToasts);
     actionCenter.SetRender(&app);
 
     StartHttpServer();
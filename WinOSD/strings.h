@@ -1,11 +1,18 @@
 #pragma once
 
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <vector>
 
+#include "grapheme.h"
+#include "utf.h"
+
 #ifdef _WIN32
 namespace {
 #include <Windows.h>
@@ -30,12 +37,12 @@ namespace {
 #define IS_LOW_SURROGATE(wch)  (((wch) >= LOW_SURROGATE_START) && ((wch) <= LOW_SURROGATE_END))
 #define IS_SURROGATE_PAIR(hs, ls) (IS_HIGH_SURROGATE(hs) && IS_LOW_SURROGATE(ls))
 
-static inline int _wtoa(const wchar_t *w, char *a, int chars, UINT codepage = 0)
+static inline int _wtoa(const wchar_t *w, char *a, int chars, unsigned int codepage = 0)
 {
     return wcstombs(a, w, chars - 1) + 1;
 }
 
-static inline int _atow(const char *a, wchar_t *w, int chars, UINT codepage = 0)
+static inline int _atow(const char *a, wchar_t *w, int chars, unsigned int codepage = 0)
 {
     return mbstowcs(w, a, chars - 1) + 1;
 }
@@ -62,56 +69,10 @@ static inline uint32_t decode_utf16_pair(const uint16_t *units)
     return code;
 }
 
+// Extended_Pictographic, whether a whole cluster is emoji is decided by unicode::NextGrapheme
 static inline bool is_emoji(uint32_t ch)
 {
-    // [0x2100, 0x214F], [0x2300, 0x23FF]
-    // [0x2600, 0x27BF], [0x2b50, 0x2b55], [0x2B1B, 0x2B1C]
-
-    // [0x1F000, 0x1FFFF]
-
-    if (0x1FFFF < ch) {
-        // (0x1FFFF, ch, inf)
-        return false;
-    }
-
-    // [0x0000, ch, 0x1FFFF]
-
-    if (0x1F000 <= ch) {
-        // [0x1F000, ch, 0x1FFFF]
-        return true;
-    }
-
-    // [0x0000, ch, 0x1F000)
-
-    if (0x2600 <= ch) {
-        // [0x2600, ch, 0x1F000)
-
-        if (ch <= 0x27BF) {
-            // [0x2600, ch, 0x27BF]
-            return true;
-        }
-
-        if (0x2b50 <= ch && ch <= 0x2b55) {
-            return true;
-        }
-
-        if (0x2B1B <= ch && ch <= 0x2B1C) {
-            return true;
-        }
-    } else if (0x2100 <= ch) {
-        // [0x2100, ch, 0x2600)
-
-        if (ch <= 0x214F) {
-            // [0x2100, ch, 0x214F]
-            return true;
-        }
-
-        if (0x2300 <= ch && ch <= 0x23FF) {
-            return true;
-        }
-    }
-
-    return false;
+    return unicode::GetProperties(ch).extendedPictographic();
 }
 
 static inline char32_t decode_utf16(const wchar_t *units)
@@ -128,494 +89,93 @@ static inline char32_t decode_utf16(const wchar_t *units)
     return units[0];
 }
 
-static inline char32_t decode_utf8(const char *units)
-{
-    char c = units[0];
-    const char payload = 0b00111111;
-
-    // Zero continuation (0 to 0x7F), 0xxxxxxx
-    if (c <= 0b01111111) {
-        return c & 0x7f;
-    }
-
-    // One continuation (0x80 to 0x7FF) 110xxxxx 10xxxxxx
-    if (c <= 0b11011111) {
-        return (c & 0b00011111) << 6
-            | units[1] & payload;
-    }
-
-    // Two continuations(0x800 to 0xD7FF and 0xE000 to 0xFFFF) 1110xxxx 10xxxxxx 10xxxxxx
-    if (c <= 0b11101111) {
-#ifdef _DEBUG // UTF-16 surrogates
-        uint32_t tmp = (c & 0b00001111) << 12
-            | units[1] & payload << 6
-            | units[2] & payload;
-
-        assert(0xD7FF < tmp && tmp < 0xE000);
-#endif
-
-        return (c & 0b00001111) << 12
-            | units[1] & payload << 6
-            | units[2] & payload;
-    }
-
-    // Three continuations(0x10000 to 0x10FFFF) 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx
-    if (c <= 0b11110111) {
-        return (c & 0b00000111) << 18
-            | units[1] & payload << 12
-            | units[2] & payload << 6
-            | units[3] & payload;
-    }
-
-#ifdef _DEBUG // double check if we have valid utf-8 char
-    __debugbreak();
-#endif
-
-    if (c <= 0b11111011) {
-        return (c & 0b00000011) << 24
-            | units[1] & payload << 18
-            | units[2] & payload << 12
-            | units[3] & payload << 6
-            | units[4] & payload;
-    }
-
-    if (c <= 0b11111011) {
-        return (c & 0b00000011) << 24
-            | units[1] & payload << 18
-            | units[2] & payload << 12
-            | units[3] & payload << 6
-            | units[4] & payload;
-    }
-
-    if (c <= 0b11111101) {
-        return (c & 0b00000011) << 30
-            | units[1] & payload << 24
-            | units[2] & payload << 18
-            | units[3] & payload << 12
-            | units[4] & payload << 6
-            | units[5] & payload;
-    }
-}
-
-static inline bool has_utf8_bom(const char *in_char)
-{
-    uint8_t *in = (uint8_t *)in_char;
-    return (in && in[0] == 0xef && in[1] == 0xbb && in[2] == 0xbf);
-}
-
-static inline size_t utf8_to_wchar(const char *in, size_t insize, wchar_t *out,
-                                   size_t outsize, int flags)
-{
-    int i_insize = (int)insize;
-    int ret;
-
-    if (i_insize == 0)
-        i_insize = (int)strlen(in);
-
-    /* prevent bom from being used in the string */
-    if (has_utf8_bom(in)) {
-        if (i_insize >= 3) {
-            in += 3;
-            insize -= 3;
-        }
-    }
-
-    ret = MultiByteToWideChar(CP_UTF8, 0, in, i_insize, out, (int)outsize);
-
-    return (ret > 0) ? (size_t)ret : 0;
-}
-
-static inline size_t os_utf8_to_wcs(const char *str, size_t len, wchar_t *dst, size_t dst_size)
-{
-    size_t in_len;
-    size_t out_len;
-
-    if (!str)
-        return 0;
-
-    in_len = len ? len : strlen(str);
-    out_len = dst ? (dst_size - 1) : utf8_to_wchar(str, in_len, NULL, 0, 0);
-
-    if (dst) {
-        if (!dst_size)
-            return 0;
-
-        if (out_len)
-            out_len = utf8_to_wchar(str, in_len,
-                                    dst, out_len + 1, 0);
-
-        dst[out_len] = 0;
-    }
-
-    return out_len;
-}
-
-static inline size_t os_utf8_to_wcs_ptr(const char *str, size_t len, wchar_t **pstr)
+// One extended grapheme cluster, `text` points into the viewed string and is not null-terminated
+struct grapheme
 {
-    if (str) {
-        size_t out_len = os_utf8_to_wcs(str, len, NULL, 0);
-
-        *pstr = (wchar_t *)malloc((out_len + 1) * sizeof(wchar_t));
-        return os_utf8_to_wcs(str, len, *pstr, out_len + 1);
-    } else {
-        *pstr = NULL;
-        return 0;
-    }
-}
-
-#ifndef _WIN32
-#error assuming wchar_t is utf-16le
-#endif // !_WIN32
+    std::wstring_view text;
+    bool emoji;
+};
 
-class wstring_char
+// Iterates the grapheme clusters of a string in place, nothing is copied or
+// allocated. The string has to outlive the view.
+class grapheme_view
 {
 public:
-    template<typename _Val, typename _Base>
-    struct _iterator
+    class iterator
     {
-        size_t _cursor = 0;
-        const _Base *_base;
-
-        _Val operator*() const
+    public:
+        iterator(std::wstring_view text, size_t pos) :
+            text(text), begin(pos), end(pos), emoji(false)
         {
-            return (*_base)[_cursor];
+            end = unicode::NextGrapheme(text.data(), text.size(), begin, &emoji);
         }
-        auto &operator++()
-        {
-            _cursor += 1;
-            return *this;
-        }
-        auto operator!=(const _iterator &other) const
-        {
-            return _cursor != other._cursor;
-        }
-    };
-
-    template<typename _Val, typename _Base>
-    struct _iterator_proxy;
 
-    template<typename _Val, typename _Base>
-    struct _iterator_proxy
-    {
-        const _Base *_base;
-
-        std::tuple<const wchar_t *, bool> operator[](size_t idx) const
+        grapheme operator*() const
         {
-            return { (*_base)[idx], _base->isEmoji[idx] };
+            return { text.substr(begin, end - begin), emoji };
         }
 
-        auto begin()
+        iterator &operator++()
         {
-            return _iterator<_Val, _iterator_proxy>{ 0, this };
+            begin = end;
+            end = unicode::NextGrapheme(text.data(), text.size(), begin, &emoji);
+            return *this;
         }
 
-        auto end()
+        bool operator==(const iterator &other) const
         {
-            return _iterator<_Val, _iterator_proxy>{ _base->size(), this };
-        }
-    };
-
-    using const_iterator = _iterator<const wchar_t *, wstring_char>;
-    using emoji_iterator = _iterator_proxy<std::tuple<const wchar_t *, bool>, wstring_char>;
-
-    wstring_char() : data(nullptr), cap(0), used(0) {}
-
-    wstring_char(const wchar_t *wstr, size_t len = 0) :
-        wstring_char()
-    {
-        append(wstr, len);
-    }
-
-    wstring_char(const std::wstring &str) :
-        wstring_char(str.data(), str.size())
-    {}
-
-    wstring_char(const wstring_char &other) :
-        wstring_char()
-    {
-        if (other.data == nullptr) {
-            return;
-        }
-
-        cap = other.used;
-        used = other.used;
-
-        data = new wchar_t[used];
-        memcpy(data, other.data, used * sizeof(wchar_t));
-    }
-
-    wstring_char &operator=(const wstring_char &other)
-    {
-        if (other.data == nullptr) {
-            used = 0;
-            indices.clear();
-            if (data) {
-                data[0] = 0;
-            }
-        } else {
-            used = other.used;
-            indices = other.indices;
-
-            if (cap < used) {
-                if (data) {
-                    delete data;
-                }
-
-                cap = used;
-                data = new wchar_t[used];
-            }
-
-            memcpy(data, other.data, used * sizeof(wchar_t));
-        }
-
-        return *this;
-    }
-
-    wstring_char(wstring_char &&other) noexcept :
-        wstring_char()
-    {
-        if (other.data == nullptr) {
-            return;
-        }
-
-        cap = other.cap;
-        used = other.used;
-        data = other.data;
-        indices = std::move(other.indices);
-
-        other.data = nullptr;
-    }
-
-    wstring_char &operator=(wstring_char &&other) noexcept
-    {
-        if (other.data == nullptr) {
-            used = 0;
-            indices.clear();
-            if (data) {
-                data[0] = 0;
-            }
-        } else {
-            used = other.used;
-            indices = other.indices;
-
-            if (data) {
-                delete[] data;
-            }
-            data = other.data;
-            other.data = nullptr;
-
-            indices = std::move(other.indices);
-        }
-
-        return *this;
-    }
-
-    ~wstring_char()
-    {
-        if (data) {
-            delete[] data;
-        }
-    }
-
-    // TODO: find selector and correctly split emoji
-    void append(const wchar_t *wstr, size_t len = 0)
-    {
-        if (len == 0) {
-            len = wcslen(wstr);
-            if (len == 0) {
-                return;
-            }
-        }
-
-        // worse case, utf16 2 wchar + 1 null
-        if (cap < len * 3 + used) {
-            auto *buf = new wchar_t[used + len * 3];
-            if (data != nullptr) {
-                memcpy(buf, data, used * sizeof(wchar_t));
-                delete[] data;
-            }
-
-            data = buf;
-            cap = used + len * 3;
-        }
-
-        size_t p = used;
-        for (int i = 0; i < len; data[p++] = 0) {
-            indices.push_back(p);
-
-            bool bmp = IS_SURROGATE_PAIR(wstr[i], wstr[i + 1]);
-            uint32_t u32 = bmp ? decode_utf16_pair((uint16_t *)(wstr + i)) : wstr[i];
-
-            if (bmp) {
-                data[p++] = wstr[i++];
-                data[p++] = wstr[i++];
-            } else {
-                data[p++] = wstr[i++];
-            }
-
-            if (!is_emoji(u32)) {
-                isEmoji.push_back(false);
-                continue;
-            } else {
-                isEmoji.push_back(true);
-            }
-
-            // if first char is emoji, then it is emoji until it is not
-            // to correctly split emoji, we need to check next code type (ZWJ and selectors)
-            while (true) {
-                if (i == len) {
-                    break;
-                }
-
-                bmp = IS_SURROGATE_PAIR(wstr[i], wstr[i + 1]);
-                u32 = bmp ? decode_utf16_pair((uint16_t *)(wstr + i)) : wstr[i];
-
-                // Variation Selector-16, Zero Width Joiner, emoji,
-                // Combining Enclosing Keycap, Tags & Variation Selectors Supplement
-                if (u32 == 0xFE0F || u32 == 0x200D || is_emoji(u32)
-                    || u32 == 0x20E3 || (0xE0000 <= u32 && u32 <= 0xE01EF)) {
-                    if (bmp) {
-                        data[p++] = wstr[i++];
-                        data[p++] = wstr[i++];
-                    } else {
-                        data[p++] = wstr[i++];
-                    }
-                } else {
-                    break;
-                }
-            }
-        }
-
-        used += p;
-    }
-
-    wstring_char &operator=(const wchar_t *wstr)
-    {
-        clear();
-        append(wstr);
-        return *this;
-    }
-
-    wstring_char &operator=(const std::wstring &wstr)
-    {
-        clear();
-        append(wstr.data(), wstr.size());
-        return *this;
-    }
-
-    wstring_char &operator+=(const wchar_t *wstr)
-    {
-        append(wstr);
-        return *this;
-    }
-
-    wstring_char &operator+=(const std::wstring &wstr)
-    {
-        append(wstr.data(), wstr.size());
-        return *this;
-    }
-
-    std::u32string to_u32string() const
-    {
-        std::u32string u32str;
-        for (const auto &idx : indices) {
-            if (*(data + idx + 1) == 0) {
-                u32str.push_back(data[idx]);
-            } else {
-                u32str.push_back(decode_utf16_pair((uint16_t *)(data + idx)));
-            }
+            return begin == other.begin;
         }
-        return u32str;
-    }
 
-    std::wstring to_wstring() const
-    {
-        std::wstring str;
-        for (const auto &idx : indices) {
-            str.append(data + idx);
+        bool operator!=(const iterator &other) const
+        {
+            return begin != other.begin;
         }
-        return str;
-    }
 
-    std::vector<std::wstring> to_wstrings() const
-    {
-        std::vector<std::wstring> strs;
-        for (const auto &idx : indices) {
-            strs.emplace_back(data + idx);
+        // offset of the current cluster in the viewed string
+        size_t offset() const
+        {
+            return begin;
         }
-        return strs;
-    }
-
-    const_iterator begin() const
-    {
-        return const_iterator{ 0, const_cast<wstring_char *>(this) };
-    }
 
-    const_iterator end() const
-    {
-        return const_iterator{ size(), const_cast<wstring_char *>(this) };
-    }
-
-    emoji_iterator items() const
-    {
-        return emoji_iterator{ this };
-    }
+    private:
+        std::wstring_view text;
+        size_t begin;
+        size_t end;
+        bool emoji;
+    };
 
-    void clear()
-    {
-        used = 0;
-        indices.clear();
-        data[0] = 0;
-    }
+    grapheme_view() = default;
 
-    size_t size() const
-    {
-        return indices.size();
-    }
+    explicit grapheme_view(std::wstring_view text) : text(text) {}
 
-    size_t length() const
+    iterator begin() const
     {
-        return indices.size();
+        return iterator(text, 0);
     }
 
-    size_t capacity() const
+    iterator end() const
     {
-        return cap;
+        return iterator(text, text.size());
     }
 
-    // copy data to a smaller buffer
-    void shrink_to_fit()
+    // number of clusters, walks the whole string
+    size_t count() const
     {
-        if (used == cap || data == nullptr) {
-            return;
+        size_t n = 0;
+        for (size_t i = 0; i < text.size(); n++) {
+            i = unicode::NextGrapheme(text.data(), text.size(), i);
         }
-
-        auto *buf = new wchar_t[used]; // additional null-char included
-        memcpy(buf, data, used);
-        delete data;
-
-        data = buf;
-        cap = used;
+        return n;
     }
 
-    // unsafe method, memory management hand-off to caller
-    wchar_t *at(size_t idx) const
+    bool empty() const
     {
-        return &data[indices[idx]];
-    }
-
-    const wchar_t *operator[] (size_t idx) const
-    {
-        return &data[indices[idx]];
+        return text.empty();
     }
 
 private:
-    size_t cap;
-    size_t used;
-    wchar_t *data;
-
-    std::vector<bool> isEmoji;
-    std::vector<size_t> indices;
+    std::wstring_view text;
 };
 
 namespace std {
@@ -665,15 +225,37 @@ static inline std::wstring atow(const std::string &string)
     return s;
 }
 
-// on windows, wchar_t should be stored as UTF-16LE
-static inline std::wstring u8tow(const std::string &string)
+// convert utf-8 to utf-16 into `buffer` and keep its memory, the view is valid
+// until the buffer is modified
+template<typename Char16>
+static inline std::basic_string_view<Char16> u8tou16(std::string_view string, std::basic_string<Char16> &buffer)
 {
-    int len = _atow(string.data(), 0, 0, CP_UTF8);
-    wchar_t *buffer = new wchar_t[len];
-    memset(buffer, 0, len * sizeof(*buffer));
-    _atow(string.data(), buffer, (int)len, CP_UTF8);
-    std::wstring s = buffer;
-    delete[] buffer;
+    static_assert(sizeof(Char16) == sizeof(char16_t), "utf-16 code units");
+
+    buffer.resize(string.size());
+    auto *out = (char16_t *)buffer.data();
+
+    size_t written = 0;
+    for (size_t i = 0;;) {
+        auto r = utf::utf8_to_utf16(string.data() + i, string.size() - i, out + written);
+        written += r.written;
+        if (r.ok()) {
+            break;
+        }
+
+        // like MultiByteToWideChar, an invalid sequence becomes U+FFFD
+        out[written++] = 0xFFFD;
+        i += r.error + 1;
+    }
+
+    buffer.resize(written);
+    return buffer;
+}
+
+static inline std::u16string u8tou16(const std::string &string)
+{
+    std::u16string s;
+    u8tou16(string, s);
     return s;
 }
 
@@ -689,18 +271,57 @@ static inline std::string wtoa(const std::wstring &string)
     return s;
 }
 
-// convert utf-16le to utf-8
-static inline std::string wtou8(const std::wstring &string)
+// convert utf-16 to utf-8
+template<typename Char16>
+static inline std::string u16tou8(const Char16 *string, size_t len)
 {
-    int len = _wtoa(string.data(), 0, 0, CP_UTF8);
-    char *buffer = new char[len];
-    memset(buffer, 0, len * sizeof(*buffer));
-    _wtoa(string.data(), buffer, (int)len, CP_UTF8);
-    std::string s = buffer;
-    delete[] buffer;
+    static_assert(sizeof(Char16) == sizeof(char16_t), "utf-16 code units");
+
+    std::string s(len * 3, '\0');
+    auto *in = (const char16_t *)string;
+
+    size_t written = 0;
+    for (size_t i = 0;;) {
+        auto r = utf::utf16_to_utf8(in + i, len - i, s.data() + written);
+        written += r.written;
+        if (r.ok()) {
+            break;
+        }
+
+        // an unpaired surrogate
+        s.replace(written, 3, "\xEF\xBF\xBD");
+        written += 3;
+        i += r.error + 1;
+    }
+
+    s.resize(written);
+    return s;
+}
+
+static inline std::string u16tou8(const std::u16string &string)
+{
+    return u16tou8(string.data(), string.size());
+}
+
+// wchar_t is utf-16le on windows only, elsewhere use the u16 versions above
+#if WCHAR_MAX == 0xFFFF
+static inline std::wstring_view u8tow(std::string_view string, std::wstring &buffer)
+{
+    return u8tou16(string, buffer);
+}
+
+static inline std::wstring u8tow(const std::string &string)
+{
+    std::wstring s;
+    u8tou16(string, s);
     return s;
 }
 
+static inline std::string wtou8(const std::wstring &string)
+{
+    return u16tou8(string.data(), string.size());
+}
+
 static inline std::u32string wtou32(const std::wstring &string)
 {
     std::u32string u32str;
@@ -726,69 +347,36 @@ static inline std::u32string wtou32(const std::wstring &string)
 
     return u32str;
 }
+#endif // WCHAR_MAX == 0xFFFF
 
-static inline std::u32string atou32(const std::string &string)
+// invalid UTF-8 sequences become U+FFFD, `error` receives the offset of the first one or utf::result::npos
+static inline std::u32string atou32(const std::string &string, size_t *error = nullptr)
 {
-    std::u32string str;
-    str.reserve(string.size()); // expect all one byte
-
-    const char payload = 0b00111111;
-
-    size_t i;
-    uint32_t tmp;
-    for (i = 0; i < string.size(); str.push_back(tmp)) {
-        char c = string[i];
-
-        // Zero continuation (0 to 0x7F), 0xxxxxxx
-        if (c <= 0b01111111) {
-            tmp = c & 0x7f;
-            i += 1;
-            continue;
-        }
+    std::u32string str(string.size(), 0);
 
-        // One continuation (0x80 to 0x7FF) 110xxxxx 10xxxxxx
-        if (c <= 0b11011111) {
-            tmp = (c & 0b00011111) << 6
-                | string[i + 1] & payload;
-            i += 2;
+    size_t written = 0;
+    size_t firstError = utf::result::npos;
 
-            assert(0x80 <= tmp && tmp <= 0x7FF);
-            continue;
+    for (size_t i = 0; i < string.size(); ) {
+        auto r = utf::utf8_to_utf32(string.data() + i, string.size() - i, str.data() + written);
+        written += r.written;
+        if (r.ok()) {
+            break;
         }
 
-        // Two continuations(0x800 to 0xD7FF and 0xE000 to 0xFFFF) 1110xxxx 10xxxxxx 10xxxxxx
-        if (c <= 0b11101111) {
-            tmp = (c & 0b00001111) << 12
-                | string[i + 1] & payload << 6
-                | string[i + 2] & payload;
-            i += 3;
-
-            if (0xD7FF < tmp && tmp < 0xE000) { // UTF-16 surrogates
-                throw new std::runtime_error("invalid UTF-8 string");
-            }
-
-            assert(0x800 <= tmp && tmp <= 0xFFFF);
-            continue;
+        if (firstError == utf::result::npos) {
+            firstError = i + r.error;
         }
 
-        // Three continuations(0x10000 to 0x10FFFF) 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx
-        if (c <= 0b11110111) {
-            tmp = (c & 0b00000111) << 18
-                | string[i + 1] & payload << 12
-                | string[i + 2] & payload << 6
-                | string[i + 3] & payload;
-            i += 4;
-
-            assert(0x10000 <= tmp && tmp <= 0x10FFFF);
-            continue;
-        }
-
-        throw new std::runtime_error("invalid UTF-8 string");
+        str[written++] = 0xFFFD;
+        i += r.error + 1;
     }
 
-    assert(i == string.size());
-    assert(str == wtou32(atow(string)));
+    if (error) {
+        *error = firstError;
+    }
 
+    str.resize(written);
     return str;
 }
 
@@ -256,8 +256,8 @@ private:
     __stream_##name.push_back({__timer_##name.ms() - __delta_##name, text, __LOGGING_FILE}); \
     __delta_##name = __timer_##name.ms();
 
-#define TIMEITF(name, text, lambda) __delta_##name = __timer_##name.ms(); lambda(); TIMEIT(##name, text)
-#define TIMEITB(name, text, ...) __delta_##name = __timer_##name.ms(); __VA_ARGS__ TIMEIT(##name, text)
+#define TIMEITF(name, text, lambda) __delta_##name = __timer_##name.ms(); lambda(); TIMEIT(name, text)
+#define TIMEITB(name, text, ...) __delta_##name = __timer_##name.ms(); __VA_ARGS__ TIMEIT(name, text)
 
 // the report will take around 1ms
 #define TIMEIT_END(name) auto __elapsed_##name = __timer_##name.ms(); \
@@ -0,0 +1,259 @@
+#include "utf.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UTF_SSE2
+#endif
+
+namespace utf
+{
+namespace
+{
+inline bool is_continuation(uint8_t c)
+{
+    return (c & 0xC0) == 0x80;
+}
+
+// Decodes the non-ASCII sequence at `in`, returns its length or 0 if it is invalid
+// or cut off by the end of the input. The allowed ranges of the second byte follow
+// the table 3-7 in the Unicode standard, which rules out overlong forms, surrogates
+// and anything above U+10FFFF.
+inline int decode_sequence(const uint8_t *in, size_t left, uint32_t &cp)
+{
+    uint8_t c = in[0];
+
+    if (c >= 0xC2 && c <= 0xDF) {
+        if (left < 2 || !is_continuation(in[1])) {
+            return 0;
+        }
+
+        cp = (uint32_t)(c & 0x1F) << 6 | (in[1] & 0x3F);
+        return 2;
+    }
+
+    if (c >= 0xE0 && c <= 0xEF) {
+        if (left < 3) {
+            return 0;
+        }
+
+        uint8_t lo = c == 0xE0 ? 0xA0 : 0x80;
+        uint8_t hi = c == 0xED ? 0x9F : 0xBF;
+        if (in[1] < lo || in[1] > hi || !is_continuation(in[2])) {
+            return 0;
+        }
+
+        cp = (uint32_t)(c & 0x0F) << 12 | (uint32_t)(in[1] & 0x3F) << 6 | (in[2] & 0x3F);
+        return 3;
+    }
+
+    if (c >= 0xF0 && c <= 0xF4) {
+        if (left < 4) {
+            return 0;
+        }
+
+        uint8_t lo = c == 0xF0 ? 0x90 : 0x80;
+        uint8_t hi = c == 0xF4 ? 0x8F : 0xBF;
+        if (in[1] < lo || in[1] > hi || !is_continuation(in[2]) || !is_continuation(in[3])) {
+            return 0;
+        }
+
+        cp = (uint32_t)(c & 0x07) << 18 | (uint32_t)(in[1] & 0x3F) << 12
+            | (uint32_t)(in[2] & 0x3F) << 6 | (in[3] & 0x3F);
+        return 4;
+    }
+
+    return 0;
+}
+}
+
+result utf8_to_utf16(const char *src, size_t len, char16_t *dst)
+{
+    const uint8_t *in = (const uint8_t *)src;
+    char16_t *out = dst;
+
+    result r;
+    size_t i = 0;
+
+    while (i < len) {
+#ifdef UTF_SSE2
+        // widen 16 ASCII bytes at once
+        if (i + 16 <= len) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+            if (_mm_movemask_epi8(v) == 0) {
+                const __m128i zero = _mm_setzero_si128();
+                _mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi8(v, zero));
+                _mm_storeu_si128((__m128i *)(out + 8), _mm_unpacklo_epi8(_mm_unpackhi_epi64(v, v), zero));
+                out += 16;
+                i += 16;
+                continue;
+            }
+        }
+
+        // decode one by one up to the end of this block
+        size_t end = i + 16 < len ? i + 16 : len;
+#else
+        size_t end = len;
+#endif
+
+        while (i < end) {
+            uint8_t c = in[i];
+
+            if (c < 0x80) {
+                *out++ = c;
+                i += 1;
+                continue;
+            }
+
+            uint32_t cp;
+            int n = decode_sequence(in + i, len - i, cp);
+            if (n == 0) {
+                break;
+            }
+
+            if (cp < 0x10000) {
+                *out++ = (char16_t)cp;
+            } else {
+                cp -= 0x10000;
+                *out++ = (char16_t)(0xD800 | cp >> 10);
+                *out++ = (char16_t)(0xDC00 | (cp & 0x3FF));
+            }
+            i += n;
+        }
+
+        if (i < end) {
+            r.error = i;
+            break;
+        }
+    }
+
+    r.written = out - dst;
+    return r;
+}
+
+result utf8_to_utf32(const char *src, size_t len, char32_t *dst)
+{
+    const uint8_t *in = (const uint8_t *)src;
+    char32_t *out = dst;
+
+    result r;
+    size_t i = 0;
+
+    while (i < len) {
+#ifdef UTF_SSE2
+        // widen 16 ASCII bytes at once
+        if (i + 16 <= len) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+            if (_mm_movemask_epi8(v) == 0) {
+                const __m128i zero = _mm_setzero_si128();
+                __m128i lo = _mm_unpacklo_epi8(v, zero);
+                __m128i hi = _mm_unpackhi_epi8(v, zero);
+                _mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi16(lo, zero));
+                _mm_storeu_si128((__m128i *)(out + 4), _mm_unpackhi_epi16(lo, zero));
+                _mm_storeu_si128((__m128i *)(out + 8), _mm_unpacklo_epi16(hi, zero));
+                _mm_storeu_si128((__m128i *)(out + 12), _mm_unpackhi_epi16(hi, zero));
+                out += 16;
+                i += 16;
+                continue;
+            }
+        }
+
+        size_t end = i + 16 < len ? i + 16 : len;
+#else
+        size_t end = len;
+#endif
+
+        while (i < end) {
+            uint8_t c = in[i];
+
+            if (c < 0x80) {
+                *out++ = c;
+                i += 1;
+                continue;
+            }
+
+            uint32_t cp;
+            int n = decode_sequence(in + i, len - i, cp);
+            if (n == 0) {
+                break;
+            }
+
+            *out++ = cp;
+            i += n;
+        }
+
+        if (i < end) {
+            r.error = i;
+            break;
+        }
+    }
+
+    r.written = out - dst;
+    return r;
+}
+
+result utf16_to_utf8(const char16_t *src, size_t len, char *dst)
+{
+    const uint16_t *in = (const uint16_t *)src;
+    uint8_t *out = (uint8_t *)dst;
+
+    result r;
+    size_t i = 0;
+
+    while (i < len) {
+#ifdef UTF_SSE2
+        // narrow 8 ASCII units at once
+        if (i + 8 <= len) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16((short)0xFF80)), _mm_setzero_si128())) == 0xFFFF) {
+                _mm_storel_epi64((__m128i *)out, _mm_packus_epi16(v, v));
+                out += 8;
+                i += 8;
+                continue;
+            }
+        }
+
+        size_t end = i + 8 < len ? i + 8 : len;
+#else
+        size_t end = len;
+#endif
+
+        while (i < end) {
+            uint16_t c = in[i];
+
+            if (c < 0x80) {
+                *out++ = (uint8_t)c;
+                i += 1;
+            } else if (c < 0x800) {
+                *out++ = (uint8_t)(0xC0 | c >> 6);
+                *out++ = (uint8_t)(0x80 | (c & 0x3F));
+                i += 1;
+            } else if (c < 0xD800 || c > 0xDFFF) {
+                *out++ = (uint8_t)(0xE0 | c >> 12);
+                *out++ = (uint8_t)(0x80 | (c >> 6 & 0x3F));
+                *out++ = (uint8_t)(0x80 | (c & 0x3F));
+                i += 1;
+            } else {
+                // a high surrogate followed by a low one
+                if (c > 0xDBFF || i + 1 >= len || in[i + 1] < 0xDC00 || in[i + 1] > 0xDFFF) {
+                    break;
+                }
+
+                uint32_t cp = 0x10000 + ((uint32_t)(c & 0x3FF) << 10 | (in[i + 1] & 0x3FF));
+                *out++ = (uint8_t)(0xF0 | cp >> 18);
+                *out++ = (uint8_t)(0x80 | (cp >> 12 & 0x3F));
+                *out++ = (uint8_t)(0x80 | (cp >> 6 & 0x3F));
+                *out++ = (uint8_t)(0x80 | (cp & 0x3F));
+                i += 2;
+            }
+        }
+
+        if (i < end) {
+            r.error = i;
+            break;
+        }
+    }
+
+    r.written = (char *)out - dst;
+    return r;
+}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Validating UTF-8 <-> UTF-16 and UTF-8 -> UTF-32 transcoding without any OS dependency. Runs of
+// ASCII, the common case for toast text, are converted 16 bytes at a time.
+namespace utf
+{
+struct result
+{
+    static constexpr size_t npos = (size_t)-1;
+
+    // code units written to the output
+    size_t written = 0;
+
+    // offset of the first invalid code unit sequence in the input, or npos;
+    // everything in front of it is converted
+    size_t error = npos;
+
+    bool ok() const
+    {
+        return error == npos;
+    }
+};
+
+// Every UTF-8 byte becomes at most one UTF-16 unit, dst must hold `len` units
+result utf8_to_utf16(const char *src, size_t len, char16_t *dst);
+
+// Every UTF-8 byte becomes at most one code point, dst must hold `len` code points
+result utf8_to_utf32(const char *src, size_t len, char32_t *dst);
+
+// Every UTF-16 unit becomes at most 3 bytes, dst must hold `len * 3` bytes
+result utf16_to_utf8(const char16_t *src, size_t len, char *dst);
+}
@@ -0,0 +1,71 @@
+#include <benchmark/benchmark.h>
+
+#include "base64.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+// an image payload as the POST handler receives it
+std::string Payload(size_t bytes)
+{
+    std::mt19937 rng(bytes);
+    std::string raw(bytes, '\0');
+    for (auto &c : raw) {
+        c = (char)rng();
+    }
+    return base64_encode(raw);
+}
+
+void BM_Base64Legacy(benchmark::State &state)
+{
+    auto encoded = Payload((size_t)state.range(0));
+    std::vector<uint8_t> out(base64::max_decoded_size(encoded.size()));
+
+    for (auto _ : state) {
+        auto r = base64::decode(out.data(), encoded.data(), encoded.size());
+        benchmark::DoNotOptimize(r);
+    }
+
+    state.SetBytesProcessed(state.iterations() * (int64_t)encoded.size());
+}
+
+void BM_Base64Strict(benchmark::State &state)
+{
+    auto encoded = Payload((size_t)state.range(0));
+    std::vector<uint8_t> out(base64::max_decoded_size(encoded.size()));
+
+    for (auto _ : state) {
+        auto r = base64::strict_decode(out.data(), encoded.data(), encoded.size());
+        benchmark::DoNotOptimize(r);
+    }
+
+    state.SetBytesProcessed(state.iterations() * (int64_t)encoded.size());
+}
+
+// chunks of an odd size, so most of them end in the middle of a block
+void BM_Base64Streaming(benchmark::State &state)
+{
+    auto encoded = Payload((size_t)state.range(0));
+    std::vector<uint8_t> out(base64::max_decoded_size(encoded.size()));
+    const size_t chunk = 4093;
+
+    for (auto _ : state) {
+        base64::decoder d;
+        size_t written = 0;
+        for (size_t i = 0; i < encoded.size(); i += chunk) {
+            size_t n = std::min(chunk, encoded.size() - i);
+            written += d.feed(out.data() + written, encoded.data() + i, n).written;
+        }
+        written += d.finish(out.data() + written).written;
+        benchmark::DoNotOptimize(written);
+    }
+
+    state.SetBytesProcessed(state.iterations() * (int64_t)encoded.size());
+}
+}
+
+BENCHMARK(BM_Base64Legacy)->Arg(4 << 10)->Arg(256 << 10)->Arg(4 << 20);
+BENCHMARK(BM_Base64Strict)->Arg(4 << 10)->Arg(256 << 10)->Arg(4 << 20);
+BENCHMARK(BM_Base64Streaming)->Arg(4 << 10)->Arg(256 << 10)->Arg(4 << 20);
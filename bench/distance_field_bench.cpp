@@ -0,0 +1,75 @@
+#include <benchmark/benchmark.h>
+
+#include "DistanceField.h"
+
+#include <vector>
+
+namespace {
+// a ring as a stand-in for a glyph, `size` output pixels square at 4x
+std::vector<uint8_t> GlyphMask(int size, int scale)
+{
+    int w = size * scale;
+    std::vector<uint8_t> mask((size_t)w * w);
+    float c = w / 2.f, outer = w * 0.4f, inner = w * 0.25f;
+    for (int y = 0; y < w; y++) {
+        for (int x = 0; x < w; x++) {
+            float d2 = (x - c) * (x - c) + (y - c) * (y - c);
+            mask[(size_t)y * w + x] = d2 <= outer * outer && d2 >= inner * inner ? 255 : 0;
+        }
+    }
+    return mask;
+}
+
+constexpr int fieldScale = 4;
+
+// a glyph of 16 to 64 pixels, as large as toast text gets
+void BM_GenerateDistanceField(benchmark::State &state)
+{
+    int size = (int)state.range(0);
+    auto mask = GlyphMask(size, fieldScale);
+    std::vector<float> field((size_t)size * size);
+
+    for (auto _ : state) {
+        GenerateDistanceField(mask.data(), (size_t)size * fieldScale, size, size, fieldScale, field.data());
+        benchmark::DoNotOptimize(field.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GenerateDistanceField)->Arg(16)->Arg(32)->Arg(64);
+
+void BM_ShadeDistanceField(benchmark::State &state)
+{
+    int size = (int)state.range(0);
+    auto mask = GlyphMask(size, fieldScale);
+    std::vector<float> field((size_t)size * size);
+    GenerateDistanceField(mask.data(), (size_t)size * fieldScale, size, size, fieldScale, field.data());
+
+    DistanceFieldShader shader(8.f, 4.f, 0.5f);
+    std::vector<uint8_t> fill(field.size()), glow(field.size());
+
+    for (auto _ : state) {
+        shader.Shade(field.data(), field.size(), fill.data(), glow.data());
+        benchmark::DoNotOptimize(glow.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ShadeDistanceField)->Arg(16)->Arg(32)->Arg(64);
+
+// what the glyph atlas stores, the fill and glow are looked up when drawn
+void BM_EncodeDistanceField(benchmark::State &state)
+{
+    int size = (int)state.range(0);
+    auto mask = GlyphMask(size, fieldScale);
+    std::vector<float> field((size_t)size * size);
+    GenerateDistanceField(mask.data(), (size_t)size * fieldScale, size, size, fieldScale, field.data());
+
+    std::vector<uint8_t> encoded(field.size());
+
+    for (auto _ : state) {
+        EncodeDistanceField(field.data(), field.size(), 8.f, encoded.data());
+        benchmark::DoNotOptimize(encoded.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_EncodeDistanceField)->Arg(16)->Arg(32)->Arg(64);
+}
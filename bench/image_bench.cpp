@@ -0,0 +1,330 @@
+#include <benchmark/benchmark.h>
+
+#include "Image.h"
+#include "ImageDecoder.h"
+#include "ImageOrient.h"
+#include "ImagePyramid.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <vector>
+
+namespace {
+// ActionCenter fits every image to LayeredRender::GetDrawableWidth()
+constexpr int toastWidth = 320;
+
+enum Format
+{
+    PNG,
+    JPEG,
+    BMP,
+    TGA,
+};
+
+const char *extensions[] = { ".png", ".jpg", ".bmp", ".tga" };
+
+// a screenshot-like BGRA image: smooth gradients, noise and sharp edges
+Image Synthetic(int w, int h)
+{
+    Image im = Image::create(w, h, 4, Image::BGR);
+
+    std::mt19937 rng(w * 31 + h);
+    for (int y = 0; y < h; y++) {
+        uint8_t *row = im.data + (size_t)y * w * 4;
+        for (int x = 0; x < w; x++) {
+            bool edge = (x / 7 + y / 11) % 5 == 0;
+            row[x * 4 + 0] = (uint8_t)(x * 255 / w);
+            row[x * 4 + 1] = (uint8_t)(y * 255 / h);
+            row[x * 4 + 2] = edge ? 255 : (uint8_t)(rng() & 0x3F);
+            row[x * 4 + 3] = 255;
+        }
+    }
+
+    return im;
+}
+
+const Image &Source(int w, int h)
+{
+    static std::map<std::pair<int, int>, Image> images;
+
+    auto &im = images[{ w, h }];
+    if (!im) {
+        im = Synthetic(w, h);
+    }
+    return im;
+}
+
+void Append(void *context, void *data, int size)
+{
+    auto *buffer = (std::vector<uint8_t> *)context;
+    buffer->insert(buffer->end(), (uint8_t *)data, (uint8_t *)data + size);
+}
+
+const std::vector<uint8_t> &Encoded(Format format, int w, int h)
+{
+    static std::map<std::tuple<Format, int, int>, std::vector<uint8_t>> files;
+
+    auto &buffer = files[{ format, w, h }];
+    if (buffer.empty()) {
+        const Image &im = Source(w, h);
+        switch (format) {
+        case PNG:
+            stbi_write_png_to_func(Append, &buffer, w, h, 4, im.data, w * 4);
+            break;
+        case JPEG:
+            stbi_write_jpg_to_func(Append, &buffer, w, h, 4, im.data, 90);
+            break;
+        case BMP:
+            stbi_write_bmp_to_func(Append, &buffer, w, h, 4, im.data);
+            break;
+        case TGA:
+            stbi_write_tga_to_func(Append, &buffer, w, h, 4, im.data);
+            break;
+        }
+    }
+    return buffer;
+}
+
+Image Copy(const Image &src)
+{
+    Image im = Image::create(src.width, src.height, src.ch, src.order);
+    memcpy(im.data, src.data, src.size());
+    im.orientation = src.orientation;
+    return im;
+}
+
+void SetPixels(benchmark::State &state, int w, int h)
+{
+    state.counters["Mpx/s"] = benchmark::Counter((double)w * h * state.iterations() / 1e6,
+                                                 benchmark::Counter::kIsRate);
+}
+
+// args: format, width, height
+void BM_ImageOpen(benchmark::State &state)
+{
+    auto format = (Format)state.range(0);
+    int w = (int)state.range(1), h = (int)state.range(2);
+    const auto &file = Encoded(format, w, h);
+
+    for (auto _ : state) {
+        Image im = Image::open(file.data(), file.size());
+        benchmark::DoNotOptimize(im.data);
+    }
+
+    state.SetLabel(extensions[format]);
+    SetPixels(state, w, h);
+}
+
+// args: mode, width, height; to the toast width like ActionCenter
+void BM_ImageResize(benchmark::State &state)
+{
+    auto mode = (Image::ResizeMode)state.range(0);
+    int w = (int)state.range(1), h = (int)state.range(2);
+    const Image &src = Source(w, h);
+
+    Image dst = Image::create(toastWidth, h * toastWidth / w, 4, src.order);
+    for (auto _ : state) {
+        src.resize(dst, mode);
+        benchmark::DoNotOptimize(dst.data);
+    }
+
+    state.SetLabel(mode == Image::LinearLight ? "linear" : "naive");
+    SetPixels(state, w, h);
+}
+
+void BM_ImageCrop(benchmark::State &state)
+{
+    int w = (int)state.range(0), h = (int)state.range(1);
+    const Image &src = Source(w, h);
+
+    for (auto _ : state) {
+        Image im = src.crop(w / 8, h / 8, w / 8, h / 8);
+        benchmark::DoNotOptimize(im.data);
+    }
+
+    SetPixels(state, w, h);
+}
+
+// args: format, width, height
+void BM_ImageSave(benchmark::State &state)
+{
+    auto format = (Format)state.range(0);
+    int w = (int)state.range(1), h = (int)state.range(2);
+    const Image &src = Source(w, h);
+
+    auto path = (std::filesystem::temp_directory_path() / (std::string("winosd_bench") + extensions[format])).string();
+    for (auto _ : state) {
+        src.save(path);
+    }
+    std::remove(path.c_str());
+
+    state.SetLabel(extensions[format]);
+    SetPixels(state, w, h);
+}
+
+// fitting a decoded image to the toast when the pyramid is built, and serving
+// the toast and a half size thumbnail from it
+void BM_PyramidScaled(benchmark::State &state)
+{
+    auto mode = (Image::ResizeMode)state.range(0);
+    int w = (int)state.range(1), h = (int)state.range(2);
+    const Image &src = Source(w, h);
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        Image decoded = Copy(src);
+        state.ResumeTiming();
+
+        ImagePyramid pyramid(std::move(decoded), toastWidth, mode);
+        benchmark::DoNotOptimize(pyramid.Scaled(toastWidth));
+        benchmark::DoNotOptimize(pyramid.Scaled(toastWidth / 2));
+    }
+
+    state.SetLabel(mode == Image::LinearLight ? "linear" : "naive");
+    SetPixels(state, w, h);
+}
+
+void BM_HalveImage(benchmark::State &state)
+{
+    int w = (int)state.range(0), h = (int)state.range(1);
+    const Image &src = Source(w, h);
+
+    for (auto _ : state) {
+        Image half = HalveImage(src);
+        benchmark::DoNotOptimize(half.data);
+    }
+
+    SetPixels(state, w, h);
+}
+
+// args: EXIF orientation, width, height
+void BM_OrientImage(benchmark::State &state)
+{
+    int w = (int)state.range(1), h = (int)state.range(2);
+    Image src = Copy(Source(w, h));
+    src.orientation = (int)state.range(0);
+
+    for (auto _ : state) {
+        Image upright = OrientImage(src);
+        benchmark::DoNotOptimize(upright.data);
+    }
+
+    SetPixels(state, w, h);
+}
+
+// one real file through the decoder registry, native codecs included
+void DecodeFile(benchmark::State &state, const std::vector<uint8_t> &file)
+{
+    int w = 0, h = 0;
+    for (auto _ : state) {
+        Image im = ImageDecoder::Decode(file.data(), file.size());
+        if (!im) {
+            state.SkipWithError("unable to decode");
+            break;
+        }
+        w = im.width;
+        h = im.height;
+    }
+
+    state.SetLabel(ImageFormatName(SniffImageFormat(file.data(), file.size())));
+    state.SetBytesProcessed(state.iterations() * (int64_t)file.size());
+    SetPixels(state, w, h);
+}
+
+// Every JPEG, PNG and WebP file in $WINOSD_BENCH_CORPUS becomes a benchmark,
+// to compare the decoders on the images people actually send
+const bool corpusRegistered = [] {
+    const char *dir = std::getenv("WINOSD_BENCH_CORPUS");
+    if (!dir) {
+        return false;
+    }
+
+    // this runs before main, an exception would end the program without a word
+    std::error_code error;
+    std::vector<std::filesystem::path> paths;
+    for (std::filesystem::directory_iterator it(dir, error), end; !error && it != end; it.increment(error)) {
+        paths.push_back(it->path());
+    }
+    if (error) {
+        std::fprintf(stderr, "WINOSD_BENCH_CORPUS: unable to read %s: %s\n", dir, error.message().c_str());
+        return false;
+    }
+    std::sort(paths.begin(), paths.end());
+
+    for (auto &path : paths) {
+        std::ifstream in(path, std::ios::binary);
+        std::vector<uint8_t> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+        switch (SniffImageFormat(file.data(), file.size())) {
+        case ImageFormat::JPEG:
+        case ImageFormat::PNG:
+        case ImageFormat::WebP:
+            benchmark::RegisterBenchmark(("BM_DecodeCorpus/" + path.filename().string()).c_str(),
+                                         DecodeFile, std::move(file))
+                ->Unit(benchmark::kMillisecond);
+            break;
+        default:
+            break;
+        }
+    }
+
+    return true;
+}();
+
+// small icon, phone photo, 4K screenshot
+const std::vector<std::pair<int64_t, int64_t>> sizes = {
+    { 256, 256 }, { 1920, 1080 }, { 3840, 2160 },
+};
+
+void FormatsAndSizes(benchmark::internal::Benchmark *b)
+{
+    for (int format : { PNG, JPEG, BMP, TGA }) {
+        for (auto [w, h] : sizes) {
+            b->Args({ format, w, h });
+        }
+    }
+}
+
+void ModesAndSizes(benchmark::internal::Benchmark *b)
+{
+    for (int mode : { Image::Naive, Image::LinearLight }) {
+        for (auto [w, h] : sizes) {
+            b->Args({ mode, w, h });
+        }
+    }
+}
+
+void Sizes(benchmark::internal::Benchmark *b)
+{
+    for (auto [w, h] : sizes) {
+        b->Args({ w, h });
+    }
+}
+
+void Orientations(benchmark::internal::Benchmark *b)
+{
+    // a flip, a half turn and a quarter turn
+    for (int orientation : { 2, 3, 6 }) {
+        for (auto [w, h] : sizes) {
+            b->Args({ orientation, w, h });
+        }
+    }
+}
+}
+
+BENCHMARK(BM_ImageOpen)->Apply(FormatsAndSizes)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ImageResize)->Apply(ModesAndSizes)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ImageCrop)->Apply(Sizes)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ImageSave)->Apply(FormatsAndSizes)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_PyramidScaled)->Apply(ModesAndSizes)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_HalveImage)->Apply(Sizes)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_OrientImage)->Apply(Orientations)->Unit(benchmark::kMillisecond);
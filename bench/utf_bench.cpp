@@ -0,0 +1,59 @@
+#include <benchmark/benchmark.h>
+
+#include "strings.h"
+
+#include <string>
+
+namespace {
+// toast sized strings, a title and a text line of a chat notification each
+const char *const texts[] = {
+    // ascii
+    "Build finished: 3 warnings, 0 errors in WinOSD.vcxproj (Release|x64)",
+    // cjk
+    "\xE5\xBC\xA0\xE4\xB8\x89\xEF\xBC\x9A\xE6\x98\x8E\xE5\xA4\xA9\xE4\xB8\x8B\xE5\x8D\x88\xE4\xB8\x89\xE7\x82\xB9\xE5\xBC\x80\xE4\xBC\x9A\xEF\xBC\x8C"
+    "\xE8\xAF\xB7\xE5\x87\x86\xE6\x97\xB6\xE5\x8F\x82\xE5\x8A\xA0\xE3\x80\x82\xE4\xBC\x9A\xE8\xAE\xAE\xE5\xAE\xA4\xE5\x9C\xA8\xE4\xB8\x89\xE6\xA5\xBC\xE3\x80\x82",
+    // emoji with skin tones, zwj sequences and flags between latin text
+    "Alice: party tonight \xF0\x9F\x8E\x89\xF0\x9F\x8E\x89 bring snacks \xF0\x9F\x8D\x95\xF0\x9F\x8D\xBA "
+    "\xF0\x9F\x91\x8D\xF0\x9F\x8F\xBD \xF0\x9F\x91\xA8\xE2\x80\x8D\xF0\x9F\x91\xA9\xE2\x80\x8D\xF0\x9F\x91\xA7 "
+    "\xF0\x9F\x87\xAF\xF0\x9F\x87\xB5 see you \xF0\x9F\x98\x82",
+};
+
+const char *const names[] = { "Ascii", "Cjk", "Emoji" };
+
+void BM_Utf8ToUtf16(benchmark::State &state)
+{
+    std::string text = texts[state.range(0)];
+    state.SetLabel(names[state.range(0)]);
+
+    std::u16string buffer;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(std::u8tou16(text, buffer).data());
+    }
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_Utf8ToUtf16)->DenseRange(0, 2);
+
+void BM_Utf16ToUtf8(benchmark::State &state)
+{
+    std::u16string text = std::u8tou16(texts[state.range(0)]);
+    state.SetLabel(names[state.range(0)]);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(std::u16tou8(text));
+    }
+    state.SetBytesProcessed(state.iterations() * text.size() * sizeof(char16_t));
+}
+BENCHMARK(BM_Utf16ToUtf8)->DenseRange(0, 2);
+
+void BM_Atou32(benchmark::State &state)
+{
+    std::string text = texts[state.range(0)];
+    state.SetLabel(names[state.range(0)]);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(std::atou32(text));
+    }
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_Atou32)->DenseRange(0, 2);
+}
@@ -0,0 +1,152 @@
+"""Generate WinOSD/unicode_tables.h from the Unicode Character Database.
+
+usage: python gen_unicode_tables.py <ucd dir> [output]
+
+The directory needs these files of the same Unicode version:
+    GraphemeBreakProperty.txt  (ucd/auxiliary/)
+    DerivedCoreProperties.txt  (ucd/)
+    emoji-data.txt             (ucd/emoji/)
+"""
+
+import os
+import re
+import sys
+
+# must match unicode::GraphemeBreak in WinOSD/grapheme.h
+GRAPHEME_BREAK = [
+    'Other', 'CR', 'LF', 'Control', 'Extend', 'ZWJ', 'Regional_Indicator',
+    'Prepend', 'SpacingMark', 'L', 'V', 'T', 'LV', 'LVT',
+]
+
+# must match unicode::InCB
+INCB = ['None', 'Linker', 'Consonant', 'Extend']
+
+EXTENDED_PICTOGRAPHIC = 1 << 4
+INCB_SHIFT = 5
+
+MAX_CODE_POINT = 0x10FFFF
+
+
+def parse(path, field_filter):
+    """Yield (first, last, fields) for every data line of a UCD file"""
+    with open(path, encoding='utf-8') as f:
+        for line in f:
+            line = line.split('#', 1)[0].strip()
+            if not line:
+                continue
+
+            fields = [x.strip() for x in line.split(';')]
+            if not field_filter(fields):
+                continue
+
+            cps = fields[0].split('..')
+            first = int(cps[0], 16)
+            last = int(cps[-1], 16)
+            yield first, last, fields[1:]
+
+
+def unicode_version(path):
+    with open(path, encoding='utf-8') as f:
+        m = re.search(r'-(\d+\.\d+\.\d+)\.txt', f.readline())
+        return m.group(1) if m else 'unknown'
+
+
+def build_properties(ucd):
+    props = bytearray(MAX_CODE_POINT + 1)
+
+    path = os.path.join(ucd, 'GraphemeBreakProperty.txt')
+    for first, last, (value,) in parse(path, lambda f: len(f) == 2):
+        for cp in range(first, last + 1):
+            props[cp] = (props[cp] & ~0x0F) | GRAPHEME_BREAK.index(value)
+
+    path = os.path.join(ucd, 'emoji-data.txt')
+    for first, last, _ in parse(path, lambda f: f[1] == 'Extended_Pictographic'):
+        for cp in range(first, last + 1):
+            props[cp] |= EXTENDED_PICTOGRAPHIC
+
+    path = os.path.join(ucd, 'DerivedCoreProperties.txt')
+    for first, last, (_, value) in parse(path, lambda f: len(f) == 3 and f[1] == 'InCB'):
+        for cp in range(first, last + 1):
+            props[cp] = (props[cp] & ~(3 << INCB_SHIFT)) | INCB.index(value) << INCB_SHIFT
+
+    return props
+
+
+def split_table(props, shift):
+    """Two-level table: stage1[cp >> shift] is the block, stage2 the values"""
+    size = 1 << shift
+    blocks = {}
+    stage1 = []
+    stage2 = bytearray()
+
+    for start in range(0, len(props), size):
+        block = bytes(props[start:start + size])
+        if block not in blocks:
+            blocks[block] = len(blocks)
+            stage2 += block
+        stage1.append(blocks[block])
+
+    index_size = 1 if len(blocks) <= 256 else 2
+    return stage1, stage2, len(stage1) * index_size + len(stage2)
+
+
+def format_array(values, per_line=24):
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append('    ' + ', '.join(str(v) for v in values[i:i + per_line]) + ',')
+    return '\n'.join(lines)
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__)
+        return 1
+
+    ucd = sys.argv[1]
+    output = sys.argv[2] if len(sys.argv) > 2 else os.path.join(
+        os.path.dirname(os.path.abspath(__file__)), '..', 'WinOSD', 'unicode_tables.h')
+
+    props = build_properties(ucd)
+    version = unicode_version(os.path.join(ucd, 'GraphemeBreakProperty.txt'))
+
+    # pick the block size with the smallest tables
+    shift, (stage1, stage2, total) = min(
+        ((s, split_table(props, s)) for s in range(5, 10)), key=lambda x: x[1][2])
+
+    index_type = 'uint8_t' if max(stage1) < 256 else 'uint16_t'
+
+    with open(output, 'w', encoding='utf-8', newline='\n') as f:
+        f.write(f'''#pragma once
+
+// Generated by scripts/gen_unicode_tables.py from Unicode {version}, do not edit.
+//
+// One byte per code point: bits 0-3 Grapheme_Cluster_Break, bit 4
+// Extended_Pictographic, bits 5-6 Indic_Conjunct_Break. {total} bytes in total.
+
+#include <cstdint>
+
+namespace unicode
+{{
+namespace tables
+{{
+inline constexpr int version[3] = {{ {', '.join(version.split('.'))} }};
+
+inline constexpr int blockShift = {shift};
+
+inline constexpr {index_type} stage1[{len(stage1)}] = {{
+{format_array(stage1)}
+}};
+
+inline constexpr uint8_t stage2[{len(stage2)}] = {{
+{format_array(list(stage2))}
+}};
+}}
+}}
+''')
+
+    print(f'{output}: Unicode {version}, block {1 << shift}, {total} bytes')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
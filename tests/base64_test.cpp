@@ -0,0 +1,228 @@
+#include <gtest/gtest.h>
+
+#include "base64.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+std::string RandomBytes(std::mt19937 &rng, size_t n)
+{
+    std::string s(n, '\0');
+    for (auto &c : s) {
+        c = (char)rng();
+    }
+    return s;
+}
+
+// strict_decode into a string, `error` receives the error offset
+std::string Decode(const std::string &encoded, size_t *error = nullptr)
+{
+    std::string out(base64::max_decoded_size(encoded.size()), '\0');
+    auto r = base64::strict_decode(out.data(), encoded.data(), encoded.size());
+    if (error) {
+        *error = r.error;
+    }
+    out.resize(r.written);
+    return out;
+}
+
+// feeds `encoded` in chunks of the given sizes, cycling through them
+base64::decode_result DecodeChunked(const std::string &encoded, const std::vector<size_t> &chunks, std::string &out)
+{
+    out.assign(base64::max_decoded_size(encoded.size()) + 3, '\0');
+
+    base64::decoder d;
+    base64::decode_result r;
+    size_t written = 0;
+
+    for (size_t i = 0, k = 0; i < encoded.size(); k++) {
+        size_t n = std::min(chunks[k % chunks.size()], encoded.size() - i);
+        r = d.feed(&out[written], encoded.data() + i, n);
+        written += r.written;
+        i += n;
+        if (!r.ok()) {
+            break;
+        }
+    }
+
+    if (r.ok()) {
+        auto tail = d.finish(&out[written]);
+        written += tail.written;
+        r.error = tail.error;
+    }
+
+    r.written = written;
+    out.resize(written);
+    return r;
+}
+
+const base64::detail::isa isas[] = {
+    base64::detail::isa::scalar,
+    base64::detail::isa::ssse3,
+    base64::detail::isa::avx2,
+};
+}
+
+TEST(Base64, RoundTripsEveryLength)
+{
+    std::mt19937 rng(1);
+    for (size_t n = 0; n < 300; n++) {
+        auto raw = RandomBytes(rng, n);
+        auto encoded = base64_encode(raw);
+
+        size_t error;
+        EXPECT_EQ(Decode(encoded, &error), raw) << n;
+        EXPECT_EQ(error, base64::decode_result::npos);
+    }
+}
+
+TEST(Base64, AcceptsMissingPadding)
+{
+    EXPECT_EQ(Decode("QQ"), "A");
+    EXPECT_EQ(Decode("QUI"), "AB");
+    EXPECT_EQ(Decode("QUJD"), "ABC");
+    EXPECT_EQ(Decode("QQ=="), "A");
+    EXPECT_EQ(Decode("QUI="), "AB");
+}
+
+TEST(Base64, RejectsBrokenPadding)
+{
+    size_t error;
+
+    Decode("Q", &error);
+    EXPECT_EQ(error, 0u);
+
+    Decode("QUJDQ", &error);
+    EXPECT_EQ(error, 4u);
+
+    Decode("QQ=", &error);
+    EXPECT_NE(error, base64::decode_result::npos);
+
+    Decode("Q===", &error);
+    EXPECT_EQ(error, 1u);
+
+    // nothing may follow the padding
+    Decode("QQ==QQ==", &error);
+    EXPECT_EQ(error, 4u);
+
+    Decode("QQ=A", &error);
+    EXPECT_EQ(error, 3u);
+}
+
+TEST(Base64, ReportsTheOffsetOfEveryInvalidCharacter)
+{
+    std::mt19937 rng(2);
+    auto encoded = base64_encode(RandomBytes(rng, 300));
+    encoded.resize(encoded.size() / 4 * 4);
+
+    for (char bad : { ' ', '\n', '-', '_', '.', '\x80', '\xFF', '\0' }) {
+        for (size_t pos = 0; pos < encoded.size(); pos++) {
+            auto corrupt = encoded;
+            corrupt[pos] = bad;
+
+            size_t error;
+            auto out = Decode(corrupt, &error);
+            ASSERT_EQ(error, pos) << (int)(uint8_t)bad;
+
+            // everything in front of the block with the error is decoded
+            EXPECT_GE(out.size(), pos / 4 * 3);
+        }
+    }
+}
+
+TEST(Base64, StreamingMatchesStrictForAnySplit)
+{
+    std::mt19937 rng(3);
+    for (int round = 0; round < 200; round++) {
+        auto raw = RandomBytes(rng, rng() % 2000);
+        auto encoded = base64_encode(raw);
+        if (round % 2) {
+            // unpadded
+            while (!encoded.empty() && encoded.back() == '=') {
+                encoded.pop_back();
+            }
+        }
+
+        std::vector<size_t> chunks;
+        for (int i = 0; i < 5; i++) {
+            chunks.push_back(1 + rng() % 97);
+        }
+
+        std::string out;
+        auto r = DecodeChunked(encoded, chunks, out);
+        EXPECT_TRUE(r.ok());
+        EXPECT_EQ(out, raw);
+    }
+}
+
+TEST(Base64, StreamingReportsTheErrorAcrossChunks)
+{
+    std::mt19937 rng(4);
+    auto encoded = base64_encode(RandomBytes(rng, 900));
+
+    for (size_t pos : { 0u, 3u, 4u, 63u, 64u, 511u, 1000u }) {
+        auto corrupt = encoded;
+        corrupt[pos] = '*';
+
+        for (size_t chunk : { 1u, 3u, 7u, 64u, 4096u }) {
+            std::string out;
+            auto r = DecodeChunked(corrupt, { chunk }, out);
+            EXPECT_EQ(r.error, pos) << chunk;
+        }
+    }
+
+    // once failed, every further call reports the same error
+    base64::decoder d;
+    std::string out(16, '\0');
+    EXPECT_EQ(d.feed(out.data(), "QU*D", 4).error, 2u);
+    EXPECT_EQ(d.feed(out.data(), "QUJD", 4).error, 2u);
+    EXPECT_EQ(d.finish(out.data()).error, 2u);
+}
+
+TEST(Base64, EveryBlockDecoderMatchesTheScalarOne)
+{
+    std::mt19937 rng(5);
+
+    for (auto set : isas) {
+        if (!base64::detail::supported(set)) {
+            continue;
+        }
+
+        for (int round = 0; round < 300; round++) {
+            auto encoded = base64_encode(RandomBytes(rng, rng() % 600));
+            encoded.resize(encoded.size() / 4 * 4);
+            while (!encoded.empty() && encoded.back() == '=') {
+                encoded.resize(encoded.size() - 4);
+            }
+
+            // half of the rounds stop at an invalid character somewhere
+            size_t bad = encoded.size();
+            if (round % 2 && !encoded.empty()) {
+                bad = rng() % encoded.size();
+                encoded[bad] = "=*\n"[rng() % 3];
+            }
+
+            auto src = (const unsigned char *)encoded.data();
+            std::vector<unsigned char> expected(encoded.size() + 32), actual(encoded.size() + 32);
+
+            size_t n = base64::detail::decode_blocks(base64::detail::isa::scalar, expected.data(), src, encoded.size());
+            size_t m = base64::detail::decode_blocks(set, actual.data(), src, encoded.size());
+
+            ASSERT_EQ(n, bad / 4 * 4);
+            ASSERT_EQ(m, n) << (int)set;
+            ASSERT_TRUE(std::equal(expected.begin(), expected.begin() + n / 4 * 3, actual.begin())) << (int)set;
+        }
+    }
+}
+
+TEST(Base64, MatchesTheLegacyDecoderOnValidInput)
+{
+    std::mt19937 rng(6);
+    for (int round = 0; round < 100; round++) {
+        auto raw = RandomBytes(rng, rng() % 5000);
+        auto encoded = base64_encode(raw);
+        EXPECT_EQ(Decode(encoded), base64_decode(encoded));
+    }
+}
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+
+#include "DistanceField.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+TEST(DistanceField, HalfPlaneIsExact)
+{
+    const int width = 8, height = 4, scale = 4;
+
+    // the left half is inside, the outline is at x = 4
+    std::vector<uint8_t> mask((size_t)width * scale * height * scale);
+    for (int y = 0; y < height * scale; y++) {
+        for (int x = 0; x < width * scale / 2; x++) {
+            mask[(size_t)y * width * scale + x] = 255;
+        }
+    }
+
+    std::vector<float> field((size_t)width * height);
+    GenerateDistanceField(mask.data(), width * scale, width, height, scale, field.data());
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            EXPECT_FLOAT_EQ(field[(size_t)y * width + x], x + 0.5f - 4.f) << x << "," << y;
+        }
+    }
+}
+
+TEST(DistanceField, DiskIsCloseToTheEuclideanDistance)
+{
+    const int size = 32, scale = 4;
+    const float cx = 16.f, cy = 16.f, radius = 9.f;
+
+    std::vector<uint8_t> mask((size_t)size * scale * size * scale);
+    for (int y = 0; y < size * scale; y++) {
+        for (int x = 0; x < size * scale; x++) {
+            float dx = (x + 0.5f) / scale - cx, dy = (y + 0.5f) / scale - cy;
+            mask[(size_t)y * size * scale + x] = dx * dx + dy * dy <= radius * radius ? 255 : 0;
+        }
+    }
+
+    std::vector<float> field((size_t)size * size);
+    GenerateDistanceField(mask.data(), size * scale, size, size, scale, field.data());
+
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            float expected = std::hypot(x + 0.5f - cx, y + 0.5f - cy) - radius;
+            EXPECT_NEAR(field[(size_t)y * size + x], expected, 0.35f) << x << "," << y;
+        }
+    }
+}
+
+TEST(DistanceField, EmptyMaskIsFarOutside)
+{
+    std::vector<uint8_t> mask(16 * 16);
+    std::vector<float> field(4 * 4);
+    GenerateDistanceField(mask.data(), 16, 4, 4, 4, field.data());
+
+    DistanceFieldShader shader(8.f, 2.f, 0.5f);
+    for (float d : field) {
+        EXPECT_GT(d, shader.GetReach());
+    }
+}
+
+namespace {
+// a disk and the glow strokes along its outline rasterized by supersampling
+// every pixel, the way the outline would be filled and stroked from geometry
+struct RasterizedDisk
+{
+    static constexpr int size = 32, samples = 16;
+    static constexpr float cx = 16.f, cy = 16.f, radius = 9.f;
+
+    std::vector<float> fill, glow;
+
+    RasterizedDisk(float glowWidth, float glowStep, float opacity) :
+        fill((size_t)size * size), glow((size_t)size * size)
+    {
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                // every stroke is drawn over the ones before it
+                float transparent = 1.f;
+                for (float w = 1.f; w <= glowWidth; w += glowStep) {
+                    transparent *= 1.f - opacity * Coverage(x, y, [&](float d) { return std::abs(d) <= w / 2; });
+                }
+                glow[(size_t)y * size + x] = 1.f - transparent;
+                fill[(size_t)y * size + x] = Coverage(x, y, [](float d) { return d <= 0.f; });
+            }
+        }
+    }
+
+    // fraction of the samples in pixel (x, y) whose distance to the outline passes `inside`
+    template<typename F>
+    static float Coverage(int x, int y, F inside)
+    {
+        int count = 0;
+        for (int sy = 0; sy < samples; sy++) {
+            for (int sx = 0; sx < samples; sx++) {
+                float px = x + (sx + 0.5f) / samples, py = y + (sy + 0.5f) / samples;
+                count += inside(std::hypot(px - cx, py - cy) - radius);
+            }
+        }
+        return (float)count / (samples * samples);
+    }
+
+    static std::vector<float> Field()
+    {
+        const int scale = 4;
+        std::vector<uint8_t> mask((size_t)size * scale * size * scale);
+        for (int y = 0; y < size * scale; y++) {
+            for (int x = 0; x < size * scale; x++) {
+                float dx = (x + 0.5f) / scale - cx, dy = (y + 0.5f) / scale - cy;
+                mask[(size_t)y * size * scale + x] = dx * dx + dy * dy <= radius * radius ? 255 : 0;
+            }
+        }
+
+        std::vector<float> field((size_t)size * size);
+        GenerateDistanceField(mask.data(), size * scale, size, size, scale, field.data());
+        return field;
+    }
+};
+}
+
+TEST(DistanceField, ShaderMatchesRasterizedStrokes)
+{
+    const float glowWidth = 8.f, glowStep = 4.f, opacity = 0.5f;
+    DistanceFieldShader shader(glowWidth, glowStep, opacity);
+
+    // the widest stroke is 5, it reaches 2.5 pixels from the outline
+    EXPECT_FLOAT_EQ(shader.GetReach(), 3.f);
+
+    RasterizedDisk disk(glowWidth, glowStep, opacity);
+    auto field = RasterizedDisk::Field();
+
+    std::vector<uint8_t> fill(field.size()), glow(field.size());
+    shader.Shade(field.data(), field.size(), fill.data(), glow.data());
+
+    // the shader takes the coverage of a pixel as linear in its distance, which
+    // is off by a few percent where the outline crosses a pixel diagonally
+    float fillError = 0.f, glowError = 0.f;
+    for (size_t i = 0; i < field.size(); i++) {
+        EXPECT_NEAR(fill[i], disk.fill[i] * 255, 24) << i;
+        EXPECT_NEAR(glow[i], disk.glow[i] * 255, 24) << i;
+        fillError += std::abs(fill[i] - disk.fill[i] * 255);
+        glowError += std::abs(glow[i] - disk.glow[i] * 255);
+    }
+    EXPECT_LT(fillError / field.size(), 2.f);
+    EXPECT_LT(glowError / field.size(), 2.f);
+}
+
+TEST(DistanceField, TransferTablesMatchShader)
+{
+    const float spread = 8.f;
+    const size_t tableSize = 256;
+    DistanceFieldShader shader(8.f, 4.f, 0.5f);
+
+    std::vector<float> fillTable(tableSize), glowTable(tableSize);
+    shader.GetTransferTables(spread, tableSize, fillTable.data(), glowTable.data());
+
+    auto field = RasterizedDisk::Field();
+    std::vector<uint8_t> encoded(field.size());
+    EncodeDistanceField(field.data(), field.size(), spread, encoded.data());
+
+    std::vector<uint8_t> fill(field.size()), glow(field.size());
+    shader.Shade(field.data(), field.size(), fill.data(), glow.data());
+
+    for (size_t i = 0; i < field.size(); i++) {
+        // a byte is 1/16 pixel with this spread, the shader's glow table steps
+        // by as much again
+        EXPECT_NEAR(fillTable[encoded[i]] * 255, fill[i], 9) << i;
+        EXPECT_NEAR(glowTable[encoded[i]] * 255, glow[i], 9) << i;
+    }
+
+    // far away there is nothing, deep inside only the fill
+    EXPECT_FLOAT_EQ(fillTable[0], 0.f);
+    EXPECT_FLOAT_EQ(glowTable[0], 0.f);
+    EXPECT_FLOAT_EQ(fillTable[tableSize - 1], 1.f);
+    EXPECT_FLOAT_EQ(glowTable[tableSize - 1], 0.f);
+}
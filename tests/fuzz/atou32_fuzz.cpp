@@ -0,0 +1,59 @@
+// libFuzzer target for atou32: it never reads past the input, and what it
+// returns re-encodes to the input with every invalid sequence replaced.
+
+#include "strings.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+namespace {
+void AppendUtf8(std::string &s, char32_t cp)
+{
+    if (cp < 0x80) {
+        s += (char)cp;
+    } else if (cp < 0x800) {
+        s += (char)(0xC0 | cp >> 6);
+        s += (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        s += (char)(0xE0 | cp >> 12);
+        s += (char)(0x80 | (cp >> 6 & 0x3F));
+        s += (char)(0x80 | (cp & 0x3F));
+    } else {
+        s += (char)(0xF0 | cp >> 18);
+        s += (char)(0x80 | (cp >> 12 & 0x3F));
+        s += (char)(0x80 | (cp >> 6 & 0x3F));
+        s += (char)(0x80 | (cp & 0x3F));
+    }
+}
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    // a copy of exactly `size` bytes so ASan sees reads past the end
+    std::string input((const char *)data, size);
+
+    size_t error;
+    auto decoded = std::atou32(input, &error);
+    if (decoded.size() > size || (error != utf::result::npos && error >= size)) {
+        abort();
+    }
+
+    std::string encoded;
+    for (char32_t cp : decoded) {
+        if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+            abort();
+        }
+        AppendUtf8(encoded, cp);
+    }
+
+    if (error == utf::result::npos) {
+        if (encoded != input) {
+            abort();
+        }
+    } else if (encoded.compare(0, error, input, 0, error) != 0) {
+        abort();
+    }
+
+    return 0;
+}
@@ -0,0 +1,77 @@
+// libFuzzer target for the validating base64 decoder. The first byte picks the
+// chunk size of the streaming decode, which must agree with strict_decode.
+
+#include "base64.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size == 0) {
+        return 0;
+    }
+
+    size_t chunk = data[0] % 64 + 1;
+    auto src = (const char *)data + 1;
+    size_t len = size - 1;
+
+    std::vector<uint8_t> strict(base64::max_decoded_size(len));
+    auto r = base64::strict_decode(strict.data(), src, len);
+    if (r.written > strict.size()) {
+        abort();
+    }
+
+    std::vector<uint8_t> streamed(base64::max_decoded_size(len) + 3);
+    base64::decoder d;
+    base64::decode_result s;
+    size_t written = 0;
+    for (size_t i = 0; i < len && s.ok(); i += chunk) {
+        size_t n = len - i < chunk ? len - i : chunk;
+        s = d.feed(streamed.data() + written, src + i, n);
+        written += s.written;
+    }
+    if (s.ok()) {
+        auto tail = d.finish(streamed.data() + written);
+        written += tail.written;
+        s.error = tail.error;
+    }
+
+    if (s.error != r.error) {
+        abort();
+    }
+
+    if (!r.ok()) {
+        // the error is within the input and points at a character that can be wrong there
+        if (r.error >= len) {
+            abort();
+        }
+        return 0;
+    }
+
+    if (written != r.written || memcmp(streamed.data(), strict.data(), written) != 0) {
+        abort();
+    }
+
+    // valid input decodes to bytes which encode back to the same text, up to the padding
+    std::string encoded(base64::encoded_size(r.written), '\0');
+    encoded.resize(base64::encode(encoded.data(), strict.data(), r.written));
+
+    std::string input(src, len);
+    while (!encoded.empty() && encoded.back() == '=') {
+        encoded.pop_back();
+    }
+    while (!input.empty() && input.back() == '=') {
+        input.pop_back();
+    }
+
+    // the unused low bits of the last character are not checked
+    if (encoded.size() != input.size() || encoded.compare(0, encoded.size() - (r.written % 3 != 0), input, 0, encoded.size() - (r.written % 3 != 0)) != 0) {
+        abort();
+    }
+
+    return 0;
+}
@@ -0,0 +1,26 @@
+// Runs a fuzz driver over the files given on the command line, for compilers
+// without libFuzzer. Crashing inputs found elsewhere can be replayed with it.
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        std::ifstream file(argv[i], std::ios::binary);
+        if (!file) {
+            fprintf(stderr, "cannot open %s\n", argv[i]);
+            return 1;
+        }
+
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        LLVMFuzzerTestOneInput(data.data(), data.size());
+        printf("%s: ok\n", argv[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,59 @@
+// libFuzzer target for the UTF-8 <-> UTF-16 transcoders: everything in front of
+// the first invalid sequence has to survive the round trip, and the sequence
+// reported has to be invalid on its own too.
+
+#include "utf.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    auto src = (const char *)data;
+
+    std::vector<char16_t> u16(size);
+    auto r = utf::utf8_to_utf16(src, size, u16.data());
+    if (r.written > size) {
+        abort();
+    }
+
+    std::vector<char32_t> u32(size);
+    auto r32 = utf::utf8_to_utf32(src, size, u32.data());
+    if (r32.error != r.error) {
+        abort();
+    }
+
+    size_t valid = r.ok() ? size : r.error;
+    if (!r.ok()) {
+        // the error starts a sequence that is invalid without its prefix too
+        std::vector<char16_t> rest(size - r.error);
+        if (utf::utf8_to_utf16(src + r.error, size - r.error, rest.data()).error != 0) {
+            abort();
+        }
+    }
+
+    // the valid prefix converts back byte by byte
+    std::vector<char> u8(r.written * 3);
+    auto back = utf::utf16_to_utf8(u16.data(), r.written, u8.data());
+    if (!back.ok() || back.written != valid || memcmp(u8.data(), src, valid) != 0) {
+        abort();
+    }
+
+    // the same bytes read as UTF-16 round trip up to the first unpaired surrogate
+    std::vector<char16_t> units(size / 2);
+    memcpy(units.data(), data, units.size() * 2);
+
+    std::vector<char> narrow(units.size() * 3);
+    auto r8 = utf::utf16_to_utf8(units.data(), units.size(), narrow.data());
+    size_t paired = r8.ok() ? units.size() : r8.error;
+
+    std::vector<char16_t> wide(r8.written);
+    auto r16 = utf::utf8_to_utf16(narrow.data(), r8.written, wide.data());
+    if (!r16.ok() || r16.written != paired || memcmp(wide.data(), units.data(), paired * 2) != 0) {
+        abort();
+    }
+
+    return 0;
+}
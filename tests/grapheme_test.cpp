@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+
+#include "grapheme.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+struct BreakTest
+{
+    int line;
+    std::u32string text;
+    std::vector<bool> breaks; // in front of every code point
+};
+
+std::vector<BreakTest> LoadBreakTests()
+{
+    std::vector<BreakTest> tests;
+    std::ifstream file(WINOSD_TEST_DATA "/GraphemeBreakTest.txt");
+
+    std::string line;
+    for (int n = 1; std::getline(file, line); n++) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        BreakTest test{ n };
+        bool boundary = false;
+
+        std::istringstream in(line);
+        std::string field;
+        while (in >> field) {
+            if (field == "\xC3\xB7") { // ÷
+                boundary = true;
+            } else if (field == "\xC3\x97") { // ×
+                boundary = false;
+            } else {
+                test.text += (char32_t)std::stoul(field, nullptr, 16);
+                test.breaks.push_back(boundary);
+            }
+        }
+        tests.push_back(test);
+    }
+    return tests;
+}
+
+std::u16string ToUtf16(const std::u32string &text, std::vector<size_t> &offsets)
+{
+    std::u16string s;
+    for (char32_t cp : text) {
+        offsets.push_back(s.size());
+        if (cp < 0x10000) {
+            s += (char16_t)cp;
+        } else {
+            s += (char16_t)(0xD800 | (cp - 0x10000) >> 10);
+            s += (char16_t)(0xDC00 | (cp & 0x3FF));
+        }
+    }
+    offsets.push_back(s.size());
+    return s;
+}
+}
+
+TEST(Grapheme, BreakerPassesGraphemeBreakTest)
+{
+    auto tests = LoadBreakTests();
+    ASSERT_GT(tests.size(), 1000u);
+
+    for (auto &test : tests) {
+        unicode::GraphemeBreaker breaker;
+        for (size_t i = 0; i < test.text.size(); i++) {
+            EXPECT_EQ(breaker.next(test.text[i]), test.breaks[i]) << "line " << test.line << ", code point " << i;
+        }
+    }
+}
+
+TEST(Grapheme, NextGraphemePassesGraphemeBreakTest)
+{
+    for (auto &test : LoadBreakTests()) {
+        std::vector<size_t> offsets;
+        auto text = ToUtf16(test.text, offsets);
+
+        // a lone surrogate in the test data would pair up with the next one in UTF-16
+        bool surrogates = false;
+        for (char32_t cp : test.text) {
+            surrogates |= cp >= 0xD800 && cp <= 0xDFFF;
+        }
+        if (surrogates) {
+            continue;
+        }
+
+        std::vector<size_t> expected;
+        for (size_t i = 1; i < test.text.size(); i++) {
+            if (test.breaks[i]) {
+                expected.push_back(offsets[i]);
+            }
+        }
+        expected.push_back(text.size());
+
+        std::vector<size_t> actual;
+        for (size_t pos = 0; pos < text.size(); ) {
+            pos = unicode::NextGrapheme(text.data(), text.size(), pos);
+            actual.push_back(pos);
+        }
+
+        EXPECT_EQ(actual, expected) << "line " << test.line;
+    }
+}
+
+TEST(Grapheme, ClassifiesEmojiClusters)
+{
+    auto emoji = [](const std::u16string &text) {
+        bool emoji = false;
+        size_t end = unicode::NextGrapheme(text.data(), text.size(), 0, &emoji);
+        EXPECT_EQ(end, text.size());
+        return emoji;
+    };
+
+    EXPECT_TRUE(emoji(u"\U0001F600"));                          // grinning face
+    EXPECT_TRUE(emoji(u"\U0001F44D\U0001F3FD"));                // skin tone
+    EXPECT_TRUE(emoji(u"\U0001F468‍\U0001F469‍\U0001F467")); // family
+    EXPECT_TRUE(emoji(u"\U0001F1EF\U0001F1F5"));                // flag
+    EXPECT_TRUE(emoji(u"#️⃣"));                       // keycap
+    EXPECT_TRUE(emoji(u"❤️"));                        // VS16
+    EXPECT_FALSE(emoji(u"❤︎"));                       // VS15
+    EXPECT_FALSE(emoji(u"a"));
+    EXPECT_FALSE(emoji(u"é"));
+    EXPECT_FALSE(emoji(u"中"));
+}
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+#include "ImagePyramid.h"
+
+#include <random>
+
+namespace {
+Image RandomImage(std::mt19937 &rng, int w, int h, int ch)
+{
+    Image im = Image::create(w, h, ch, Image::RGB);
+    for (size_t i = 0; i < im.size(); i++) {
+        im.data[i] = (uint8_t)rng();
+    }
+    return im;
+}
+}
+
+TEST(ImagePyramid, HalveImageRoundsOnce)
+{
+    std::mt19937 rng(1);
+    for (int ch = 1; ch <= 4; ch++) {
+        for (int w : { 2, 3, 9, 16, 17, 33 }) {
+            Image src = RandomImage(rng, w, 6, ch);
+            Image half = HalveImage(src);
+            ASSERT_EQ(half.width, w / 2);
+            ASSERT_EQ(half.height, 3);
+
+            for (int y = 0; y < half.height; y++) {
+                for (int x = 0; x < half.width; x++) {
+                    for (int i = 0; i < ch; i++) {
+                        auto at = [&](int sx, int sy) {
+                            return src.data[((size_t)sy * src.width + sx) * ch + i];
+                        };
+                        int expected = (at(2 * x, 2 * y) + at(2 * x + 1, 2 * y) + at(2 * x, 2 * y + 1) + at(2 * x + 1, 2 * y + 1) + 2) >> 2;
+                        ASSERT_EQ(half.data[((size_t)y * half.width + x) * ch + i], expected) << ch << " " << w << " " << x;
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST(ImagePyramid, KeepsOnlyTheDisplayWidth)
+{
+    std::mt19937 rng(2);
+    ImagePyramid pyramid(RandomImage(rng, 1280, 720, 4), 320);
+
+    EXPECT_EQ(pyramid.width(), 320);
+    EXPECT_EQ(pyramid.height(), 180);
+    EXPECT_EQ(pyramid.size(), 320u * 180 * 4);
+
+    // wider requests are not upscaled
+    EXPECT_EQ(pyramid.Scaled(640)->width, 320);
+
+    auto half = pyramid.Scaled(160);
+    EXPECT_EQ(half->width, 160);
+    EXPECT_EQ(half->height, 90);
+    EXPECT_EQ(pyramid.size(), 320u * 180 * 4 + 160 * 90 * 4);
+}
+
+TEST(ImagePyramid, IsOrientedOnceWhenBuilt)
+{
+    std::mt19937 rng(3);
+
+    // rotated 90 degrees clockwise, the upright image is 100x400
+    Image src = RandomImage(rng, 400, 100, 4);
+    src.orientation = 6;
+
+    ImagePyramid pyramid(std::move(src), 50);
+    EXPECT_EQ(pyramid.width(), 50);
+    EXPECT_EQ(pyramid.height(), 200);
+
+    auto level = pyramid.Scaled(50);
+    EXPECT_EQ(level->orientation, 1);
+    EXPECT_EQ(level->width, 50);
+    EXPECT_EQ(level->height, 200);
+
+    // a smaller size is served from the upright level as is
+    auto scaled = pyramid.Scaled(25);
+    EXPECT_EQ(scaled->orientation, 1);
+    EXPECT_EQ(scaled->width, 25);
+    EXPECT_EQ(scaled->height, 100);
+}
+
+TEST(ImagePyramid, WithoutLimitKeepsTheFullSize)
+{
+    std::mt19937 rng(4);
+    ImagePyramid pyramid(RandomImage(rng, 64, 48, 3), 0);
+    EXPECT_EQ(pyramid.width(), 64);
+    EXPECT_EQ(pyramid.height(), 48);
+}
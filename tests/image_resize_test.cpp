@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+
+#include "ImageResize.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace {
+double ToLinear(uint8_t v)
+{
+    double c = v / 255.0;
+    return c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+}
+
+uint8_t ToSrgb(double l)
+{
+    double s = l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1 / 2.4) - 0.055;
+    return (uint8_t)std::lround(std::clamp(s, 0.0, 1.0) * 255);
+}
+
+// box filter in double precision with premultiplied alpha
+std::vector<uint8_t> Reference(const std::vector<uint8_t> &src, int sw, int sh, int dw, int dh, int ch)
+{
+    const int alpha = ch == 4 || ch == 2 ? ch - 1 : -1;
+    std::vector<uint8_t> dst((size_t)dw * dh * ch);
+
+    auto cover = [](int i, double start, double end) {
+        return std::max(0.0, std::min(i + 1.0, end) - std::max((double)i, start));
+    };
+
+    for (int y = 0; y < dh; y++) {
+        for (int x = 0; x < dw; x++) {
+            double sum[4] = {}, total = 0;
+            double x0 = x * (double)sw / dw, x1 = (x + 1) * (double)sw / dw;
+            double y0 = y * (double)sh / dh, y1 = (y + 1) * (double)sh / dh;
+
+            for (int sy = (int)y0; sy < std::min((int)std::ceil(y1), sh); sy++) {
+                for (int sx = (int)x0; sx < std::min((int)std::ceil(x1), sw); sx++) {
+                    double w = cover(sx, x0, x1) * cover(sy, y0, y1);
+                    const uint8_t *p = &src[((size_t)sy * sw + sx) * ch];
+                    double a = alpha >= 0 ? p[alpha] / 255.0 : 1.0;
+                    for (int i = 0; i < ch; i++) {
+                        sum[i] += w * (i == alpha ? a : ToLinear(p[i]) * a);
+                    }
+                    total += w;
+                }
+            }
+
+            uint8_t *out = &dst[((size_t)y * dw + x) * ch];
+            double a = alpha >= 0 ? sum[alpha] / total : 1.0;
+            for (int i = 0; i < ch; i++) {
+                if (i == alpha) {
+                    out[i] = (uint8_t)std::lround(a * 255);
+                } else {
+                    out[i] = a > 0 ? ToSrgb(sum[i] / total / a) : 0;
+                }
+            }
+        }
+    }
+    return dst;
+}
+}
+
+TEST(ImageResize, TransparentPixelsDoNotBleed)
+{
+    // opaque red next to transparent green
+    const uint8_t src[] = { 255, 0, 0, 255, 0, 255, 0, 0 };
+    uint8_t dst[4];
+
+    ASSERT_TRUE(ResizeLinearLight(src, 2, 1, 8, dst, 1, 1, 4, 4));
+    EXPECT_EQ(dst[0], 255);
+    EXPECT_EQ(dst[1], 0);
+    EXPECT_EQ(dst[2], 0);
+    EXPECT_NEAR(dst[3], 128, 1);
+}
+
+TEST(ImageResize, MatchesTheReferenceForEveryChannelCount)
+{
+    std::mt19937 rng(1);
+    for (int ch = 1; ch <= 4; ch++) {
+        for (int round = 0; round < 20; round++) {
+            int sw = 1 + rng() % 70, sh = 1 + rng() % 40;
+            int dw = 1 + rng() % sw, dh = 1 + rng() % sh;
+
+            std::vector<uint8_t> src((size_t)sw * sh * ch);
+            for (auto &v : src) {
+                v = (uint8_t)rng();
+            }
+
+            std::vector<uint8_t> dst((size_t)dw * dh * ch);
+            ASSERT_TRUE(ResizeLinearLight(src.data(), sw, sh, (size_t)sw * ch, dst.data(), dw, dh, (size_t)dw * ch, ch));
+
+            auto expected = Reference(src, sw, sh, dw, dh, ch);
+            for (size_t i = 0; i < dst.size(); i++) {
+                // near zero alpha the premultiplied color keeps only a few bits
+                int a = ch == 4 || ch == 2 ? expected[i - i % ch + ch - 1] : 255;
+                ASSERT_NEAR(dst[i], expected[i], a < 16 ? 255 : a < 64 ? 8 : 2) << ch << " channels, " << sw << "x" << sh
+                    << " -> " << dw << "x" << dh << " at " << i;
+            }
+        }
+    }
+}
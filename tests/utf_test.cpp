@@ -0,0 +1,242 @@
+#include <gtest/gtest.h>
+
+#include "strings.h"
+#include "utf.h"
+
+#include <random>
+#include <string>
+
+namespace {
+void AppendUtf8(std::string &s, char32_t cp)
+{
+    if (cp < 0x80) {
+        s += (char)cp;
+    } else if (cp < 0x800) {
+        s += (char)(0xC0 | cp >> 6);
+        s += (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        s += (char)(0xE0 | cp >> 12);
+        s += (char)(0x80 | (cp >> 6 & 0x3F));
+        s += (char)(0x80 | (cp & 0x3F));
+    } else {
+        s += (char)(0xF0 | cp >> 18);
+        s += (char)(0x80 | (cp >> 12 & 0x3F));
+        s += (char)(0x80 | (cp >> 6 & 0x3F));
+        s += (char)(0x80 | (cp & 0x3F));
+    }
+}
+
+void AppendUtf16(std::u16string &s, char32_t cp)
+{
+    if (cp < 0x10000) {
+        s += (char16_t)cp;
+    } else {
+        s += (char16_t)(0xD800 | (cp - 0x10000) >> 10);
+        s += (char16_t)(0xDC00 | (cp & 0x3FF));
+    }
+}
+
+// mostly ASCII with runs of every other plane, so both the block and the sequence paths run
+std::u32string RandomText(std::mt19937 &rng, size_t n)
+{
+    std::u32string s;
+    while (s.size() < n) {
+        switch (rng() % 6) {
+        case 0: s += (char32_t)(0x80 + rng() % 0x780); break;
+        case 1: s += (char32_t)(0x800 + rng() % 0xD000); break;
+        case 2: s += (char32_t)(0xE000 + rng() % 0x2000); break;
+        case 3: s += (char32_t)(0x10000 + rng() % 0x100000); break;
+        default:
+            for (size_t run = rng() % 40; run--; ) {
+                s += (char32_t)(rng() % 0x80);
+            }
+        }
+    }
+    return s;
+}
+
+struct Encoded
+{
+    std::string u8;
+    std::u16string u16;
+};
+
+Encoded Encode(const std::u32string &text)
+{
+    Encoded e;
+    for (char32_t cp : text) {
+        AppendUtf8(e.u8, cp);
+        AppendUtf16(e.u16, cp);
+    }
+    return e;
+}
+
+// every ill-formed sequence of table 3-7, and what comes before it
+const char *const invalid[] = {
+    "\x80",             // lone continuation
+    "\xBF",
+    "\xC0\x80",         // overlong
+    "\xC1\xBF",
+    "\xE0\x80\x80",
+    "\xE0\x9F\xBF",
+    "\xF0\x80\x80\x80",
+    "\xF0\x8F\xBF\xBF",
+    "\xED\xA0\x80",     // surrogates
+    "\xED\xBF\xBF",
+    "\xF4\x90\x80\x80", // above U+10FFFF
+    "\xF5\x80\x80\x80",
+    "\xFE",
+    "\xFF",
+    "\xC3",             // cut off
+    "\xE4\xB8",
+    "\xF0\x9F\x98",
+    "\xC3\x41",         // missing continuation
+    "\xE4\x41\x80",
+    "\xF0\x9F\x41\x80",
+};
+}
+
+TEST(Utf, Utf8ToUtf16MatchesTheReference)
+{
+    std::mt19937 rng(1);
+    for (int round = 0; round < 500; round++) {
+        auto e = Encode(RandomText(rng, rng() % 300));
+
+        std::u16string out(e.u8.size(), u'\0');
+        auto r = utf::utf8_to_utf16(e.u8.data(), e.u8.size(), out.data());
+        ASSERT_TRUE(r.ok());
+        out.resize(r.written);
+        ASSERT_EQ(out, e.u16);
+    }
+}
+
+TEST(Utf, Utf16ToUtf8MatchesTheReference)
+{
+    std::mt19937 rng(2);
+    for (int round = 0; round < 500; round++) {
+        auto e = Encode(RandomText(rng, rng() % 300));
+
+        std::string out(e.u16.size() * 3, '\0');
+        auto r = utf::utf16_to_utf8(e.u16.data(), e.u16.size(), out.data());
+        ASSERT_TRUE(r.ok());
+        out.resize(r.written);
+        ASSERT_EQ(out, e.u8);
+    }
+}
+
+TEST(Utf, Utf8ToUtf32MatchesTheReference)
+{
+    std::mt19937 rng(3);
+    for (int round = 0; round < 500; round++) {
+        auto text = RandomText(rng, rng() % 300);
+        auto e = Encode(text);
+
+        std::u32string out(e.u8.size(), U'\0');
+        auto r = utf::utf8_to_utf32(e.u8.data(), e.u8.size(), out.data());
+        ASSERT_TRUE(r.ok());
+        out.resize(r.written);
+        ASSERT_EQ(out, text);
+    }
+}
+
+TEST(Utf, ReportsInvalidUtf8AtEveryOffset)
+{
+    // the prefix lengths put the bad sequence at every position of an ASCII block
+    for (const char *bad : invalid) {
+        for (size_t prefix = 0; prefix < 40; prefix++) {
+            std::string s(prefix, 'a');
+            s += bad;
+            s.append(prefix % 3 == 0 ? 0 : 20, 'b');
+
+            std::u16string out16(s.size(), u'\0');
+            auto r = utf::utf8_to_utf16(s.data(), s.size(), out16.data());
+            ASSERT_EQ(r.error, prefix) << prefix;
+            ASSERT_EQ(r.written, prefix);
+            ASSERT_EQ(out16.substr(0, prefix), std::u16string(prefix, u'a'));
+
+            std::u32string out32(s.size(), U'\0');
+            r = utf::utf8_to_utf32(s.data(), s.size(), out32.data());
+            ASSERT_EQ(r.error, prefix);
+            ASSERT_EQ(r.written, prefix);
+        }
+    }
+}
+
+TEST(Utf, ReportsUnpairedSurrogates)
+{
+    for (size_t prefix = 0; prefix < 20; prefix++) {
+        for (std::u16string bad : { u"\xD800", u"\xDC00", u"\xDBFF\x41", u"\xDFFF\xD800" }) {
+            std::u16string s(prefix, u'a');
+            s += bad;
+            s += u"bbbbbbbbbb";
+
+            std::string out(s.size() * 3, '\0');
+            auto r = utf::utf16_to_utf8(s.data(), s.size(), out.data());
+            ASSERT_EQ(r.error, prefix);
+            ASSERT_EQ(r.written, prefix);
+        }
+    }
+}
+
+TEST(Utf, ReplacesInvalidSequences)
+{
+    EXPECT_EQ(std::u8tou16("a\xFF" "b"), u"a�b");
+    EXPECT_EQ(std::u8tou16("\xC3"), u"�");
+    EXPECT_EQ(std::u8tou16("\xE4\xB8" "a\xE4\xB8\xAD"), u"��a中");
+
+    const char16_t lone[] = { u'a', 0xD800, u'b' };
+    EXPECT_EQ(std::u16tou8(lone, 3), "a\xEF\xBF\xBD" "b");
+}
+
+TEST(Utf, ConvertsToastText)
+{
+    const std::string text = "\xE4\xBD\xA0\xE5\xA5\xBD " "\xF0\x9F\x91\x8B\xF0\x9F\x8F\xBD" " hello";
+    const std::u16string wide = u"你好 \U0001F44B\U0001F3FD hello";
+
+    std::u16string buffer = u"reused";
+    EXPECT_EQ(std::u8tou16(text, buffer), wide);
+    EXPECT_EQ(std::u16tou8(wide), text);
+    EXPECT_EQ(std::u8tou16(""), u"");
+    EXPECT_EQ(std::u16tou8(u""), "");
+}
+
+TEST(Utf, Atou32DecodesAndReportsTheFirstError)
+{
+    size_t error = 0;
+    EXPECT_EQ(std::atou32("", &error), U"");
+    EXPECT_EQ(error, utf::result::npos);
+
+    EXPECT_EQ(std::atou32("a\xC3\xA9\xE4\xB8\xAD\xF0\x9F\x98\x80", &error), U"aé中\U0001F600");
+    EXPECT_EQ(error, utf::result::npos);
+
+    // the operator precedence bug of the old decoder lost these bits
+    EXPECT_EQ(std::atou32("\xE2\x82\xAC"), U"€");
+    EXPECT_EQ(std::atou32("\xF4\x8F\xBF\xBF"), U"\U0010FFFF");
+
+    // truncated input is not read past its end
+    EXPECT_EQ(std::atou32("ab\xF0\x9F\x98", &error), U"ab���");
+    EXPECT_EQ(error, 2u);
+
+    EXPECT_EQ(std::atou32("\xED\xA0\x80x\xFF", &error), U"���x�");
+    EXPECT_EQ(error, 0u);
+}
+
+TEST(Utf, Atou32ReportsInvalidSequencesAfterLongAsciiRuns)
+{
+    std::mt19937 rng(4);
+    for (const char *bad : invalid) {
+        auto text = RandomText(rng, 50);
+        auto e = Encode(text);
+        std::string s = std::string(rng() % 64, 'x') + e.u8;
+        size_t at = s.size();
+        s += bad;
+
+        size_t error;
+        auto out = std::atou32(s, &error);
+        ASSERT_EQ(error, at);
+
+        size_t prefix = at - e.u8.size();
+        ASSERT_EQ(out.compare(prefix, text.size(), text), 0);
+        ASSERT_EQ(out[prefix + text.size()], U'�');
+    }
+}